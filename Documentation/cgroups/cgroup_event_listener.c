@@ -0,0 +1,126 @@
+/*
+ * cgroup_event_listener.c - Simple listener of cgroup events
+ *
+ * Registers an eventfd for a cgroup control file through
+ * cgroup.event_control and prints a line every time it is signalled.
+ *
+ * Compile with
+ *	gcc -Wall cgroup_event_listener.c -o cgroup_event_listener
+ *
+ * Usage
+ *	cgroup_event_listener <path-to-control-file> <args>
+ *
+ * e.g.	cgroup_event_listener memory.pressure_level low
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+#define USAGE_STR "Usage: cgroup_event_listener <path-to-control-file> <args>\n"
+
+int main(int argc, char **argv)
+{
+	int efd = -1;
+	int cfd = -1;
+	int event_control = -1;
+	char event_control_path[PATH_MAX];
+	char line[LINE_MAX];
+	char *dir;
+	int ret;
+
+	if (argc != 3) {
+		fputs(USAGE_STR, stderr);
+		return 1;
+	}
+
+	cfd = open(argv[1], O_RDONLY);
+	if (cfd == -1) {
+		fprintf(stderr, "Cannot open %s: %s\n", argv[1],
+				strerror(errno));
+		goto out;
+	}
+
+	/* cgroup.event_control lives next to the control file */
+	strncpy(line, argv[1], sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+	dir = dirname(line);
+	ret = snprintf(event_control_path, sizeof(event_control_path),
+			"%s/cgroup.event_control", dir);
+	if (ret >= sizeof(event_control_path)) {
+		fputs("Path to cgroup.event_control is too long\n", stderr);
+		goto out;
+	}
+
+	event_control = open(event_control_path, O_WRONLY);
+	if (event_control == -1) {
+		fprintf(stderr, "Cannot open %s: %s\n", event_control_path,
+				strerror(errno));
+		goto out;
+	}
+
+	efd = eventfd(0, 0);
+	if (efd == -1) {
+		perror("eventfd() failed");
+		goto out;
+	}
+
+	/* "<event_fd> <control_fd> <args>" registers the notification */
+	ret = snprintf(line, sizeof(line), "%d %d %s", efd, cfd, argv[2]);
+	if (ret >= sizeof(line)) {
+		fputs("Arguments string is too long\n", stderr);
+		goto out;
+	}
+
+	ret = write(event_control, line, strlen(line) + 1);
+	if (ret == -1) {
+		perror("Cannot write to cgroup.event_control");
+		goto out;
+	}
+
+	while (1) {
+		uint64_t result;
+
+		ret = read(efd, &result, sizeof(result));
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("Cannot read from eventfd");
+			break;
+		}
+		assert(ret == sizeof(result));
+
+		/* the eventfd is also signalled when the cgroup is removed */
+		ret = access(event_control_path, W_OK);
+		if ((ret == -1) && (errno == ENOENT)) {
+			puts("The cgroup seems to have been removed.");
+			break;
+		}
+
+		if (ret == -1) {
+			perror("cgroup.event_control is not accessible any more");
+			break;
+		}
+
+		printf("%s %s: crossed\n", argv[1], argv[2]);
+	}
+
+out:
+	if (efd >= 0)
+		close(efd);
+	if (event_control >= 0)
+		close(event_control);
+	if (cfd >= 0)
+		close(cfd);
+
+	return (ret != 0);
+}
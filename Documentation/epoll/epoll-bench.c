@@ -0,0 +1,183 @@
+/*
+ * epoll-bench.c - epoll ready list microbenchmark
+ *
+ * N producer threads, each bound to its own cpu, signal their own
+ * eventfd in a tight loop. All eventfds are watched (edge triggered)
+ * by a single epoll set, drained by one consumer thread. Every write
+ * runs ep_poll_callback() on the producer's cpu, so this measures how
+ * the ready list enqueue scales with the number of cpus reporting
+ * events to the same epoll set.
+ *
+ * Usage: epoll-bench [-p producers] [-t seconds]
+ *
+ * Without -p, runs with 1, 2, 4, ... producers up to the number of
+ * online cpus minus one (the consumer runs on cpu 0).
+ *
+ * Output per run: producer writes per second (ep_poll_callback()
+ * invocations) and events per second returned by epoll_wait().
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+
+#define MAX_EVENTS	256
+
+struct producer {
+	pthread_t	thread;
+	int		cpu;
+	int		efd;
+	uint64_t	writes;
+	char		pad[64];
+};
+
+static volatile int stop;
+
+static void bind_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		fprintf(stderr, "warning: cannot bind to cpu %d\n", cpu);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *producer_fn(void *arg)
+{
+	struct producer *p = arg;
+	uint64_t one = 1, writes = 0;
+
+	bind_cpu(p->cpu);
+	while (!stop) {
+		if (write(p->efd, &one, sizeof(one)) != sizeof(one)) {
+			perror("write");
+			break;
+		}
+		writes++;
+	}
+	p->writes = writes;
+
+	return NULL;
+}
+
+static void run(int nr_producers, int seconds, int ncpus)
+{
+	struct epoll_event ev, events[MAX_EVENTS];
+	struct producer *prod;
+	uint64_t nr_events = 0, writes = 0, val;
+	double start, elapsed;
+	int epfd, i, n;
+
+	prod = calloc(nr_producers, sizeof(*prod));
+	epfd = epoll_create1(0);
+	if (!prod || epfd < 0) {
+		perror("setup");
+		exit(1);
+	}
+
+	for (i = 0; i < nr_producers; i++) {
+		prod[i].cpu = 1 + i % (ncpus > 1 ? ncpus - 1 : 1);
+		prod[i].efd = eventfd(0, EFD_NONBLOCK);
+		if (prod[i].efd < 0) {
+			perror("eventfd");
+			exit(1);
+		}
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, prod[i].efd, &ev)) {
+			perror("epoll_ctl");
+			exit(1);
+		}
+	}
+
+	bind_cpu(0);
+	stop = 0;
+	for (i = 0; i < nr_producers; i++)
+		pthread_create(&prod[i].thread, NULL, producer_fn, &prod[i]);
+
+	start = now();
+	while ((elapsed = now() - start) < seconds) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			exit(1);
+		}
+		for (i = 0; i < n; i++) {
+			/* reset the counter so that it never saturates */
+			if (read(prod[events[i].data.u32].efd, &val,
+				 sizeof(val)) < 0 && errno != EAGAIN)
+				perror("read");
+		}
+		nr_events += n;
+	}
+	stop = 1;
+
+	for (i = 0; i < nr_producers; i++) {
+		pthread_join(prod[i].thread, NULL);
+		writes += prod[i].writes;
+		close(prod[i].efd);
+	}
+	close(epfd);
+	free(prod);
+
+	printf("%9d %16.0f %16.0f\n", nr_producers,
+	       writes / elapsed, nr_events / elapsed);
+}
+
+int main(int argc, char **argv)
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int producers = 0, seconds = 5;
+	int c, n;
+
+	while ((c = getopt(argc, argv, "p:t:")) != -1) {
+		switch (c) {
+		case 'p':
+			producers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-p producers] [-t seconds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%9s %16s %16s\n", "producers", "writes/s", "events/s");
+	if (producers > 0) {
+		run(producers, seconds, ncpus);
+		return 0;
+	}
+
+	for (n = 1; n < ncpus; n *= 2)
+		run(n, seconds, ncpus);
+	if (n / 2 != ncpus - 1 && ncpus > 1)
+		run(ncpus - 1, seconds, ncpus);
+	if (ncpus == 1)
+		run(1, seconds, ncpus);
+
+	return 0;
+}
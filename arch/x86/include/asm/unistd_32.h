@@ -342,10 +342,16 @@
 #define __NR_pwritev		334
 #define __NR_rt_tgsigqueueinfo	335
 #define __NR_perf_event_open	336
+#define __NR_process_vm_readv	337
+#define __NR_process_vm_writev	338
+#define __NR_sched_setattr	339
+#define __NR_sched_getattr	340
+#define __NR_io_setup_sq	341
+#define __NR_io_sq_enter	342
 
 #ifdef __KERNEL__
 
-#define NR_syscalls 337
+#define NR_syscalls 343
 
 #define __ARCH_WANT_IPC_PARSE_VERSION
 #define __ARCH_WANT_OLD_READDIR
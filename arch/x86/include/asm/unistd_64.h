@@ -661,6 +661,18 @@ __SYSCALL(__NR_pwritev, sys_pwritev)
 __SYSCALL(__NR_rt_tgsigqueueinfo, sys_rt_tgsigqueueinfo)
 #define __NR_perf_event_open			298
 __SYSCALL(__NR_perf_event_open, sys_perf_event_open)
+#define __NR_process_vm_readv			299
+__SYSCALL(__NR_process_vm_readv, sys_process_vm_readv)
+#define __NR_process_vm_writev			300
+__SYSCALL(__NR_process_vm_writev, sys_process_vm_writev)
+#define __NR_sched_setattr			301
+__SYSCALL(__NR_sched_setattr, sys_sched_setattr)
+#define __NR_sched_getattr			302
+__SYSCALL(__NR_sched_getattr, sys_sched_getattr)
+#define __NR_io_setup_sq			303
+__SYSCALL(__NR_io_setup_sq, sys_io_setup_sq)
+#define __NR_io_sq_enter			304
+__SYSCALL(__NR_io_sq_enter, sys_io_sq_enter)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
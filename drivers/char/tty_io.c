@@ -137,6 +137,9 @@ LIST_HEAD(tty_drivers);			/* linked list of tty drivers */
 DEFINE_MUTEX(tty_mutex);
 EXPORT_SYMBOL(tty_mutex);
 
+/* Spinlock to protect the tty->tty_files list */
+DEFINE_SPINLOCK(tty_files_lock);
+
 static ssize_t tty_read(struct file *, char __user *, size_t, loff_t *);
 static ssize_t tty_write(struct file *, const char __user *, size_t, loff_t *);
 ssize_t redirected_tty_write(struct file *, const char __user *,
@@ -186,6 +189,40 @@ void free_tty_struct(struct tty_struct *tty)
 	kfree(tty);
 }
 
+/**
+ *	tty_add_file	-	attach a file to a tty
+ *	@tty: tty the file was opened on
+ *	@file: file to attach
+ *
+ *	Takes the file off its superblock's file list and puts it on the
+ *	tty's list of open files instead, so that hangup can find it.
+ *
+ *	Locking: tty_files_lock
+ */
+
+void tty_add_file(struct tty_struct *tty, struct file *file)
+{
+	file->private_data = tty;
+	file_sb_list_del(file);
+	spin_lock(&tty_files_lock);
+	list_add(&file->f_u.fu_list, &tty->tty_files);
+	spin_unlock(&tty_files_lock);
+}
+
+/*
+ *	tty_del_file	-	detach a file from its tty
+ *	@file: file to detach
+ *
+ *	Locking: tty_files_lock
+ */
+
+static void tty_del_file(struct file *file)
+{
+	spin_lock(&tty_files_lock);
+	list_del_init(&file->f_u.fu_list);
+	spin_unlock(&tty_files_lock);
+}
+
 #define TTY_NUMBER(tty) ((tty)->index + (tty)->driver->name_base)
 
 /**
@@ -236,11 +273,11 @@ static int check_tty_count(struct tty_struct *tty, const char *routine)
 	struct list_head *p;
 	int count = 0;
 
-	file_list_lock();
+	spin_lock(&tty_files_lock);
 	list_for_each(p, &tty->tty_files) {
 		count++;
 	}
-	file_list_unlock();
+	spin_unlock(&tty_files_lock);
 	if (tty->driver->type == TTY_DRIVER_TYPE_PTY &&
 	    tty->driver->subtype == PTY_TYPE_SLAVE &&
 	    tty->link && tty->link->count)
@@ -518,7 +555,7 @@ static void do_tty_hangup(struct work_struct *work)
 	spin_unlock(&redirect_lock);
 
 	check_tty_count(tty, "do_tty_hangup");
-	file_list_lock();
+	spin_lock(&tty_files_lock);
 	/* This breaks for file handles being sent over AF_UNIX sockets ? */
 	list_for_each_entry(filp, &tty->tty_files, f_u.fu_list) {
 		if (filp->f_op->write == redirected_tty_write)
@@ -529,7 +566,7 @@ static void do_tty_hangup(struct work_struct *work)
 		tty_fasync(-1, filp, 0);	/* can't block */
 		filp->f_op = &hung_up_tty_fops;
 	}
-	file_list_unlock();
+	spin_unlock(&tty_files_lock);
 
 	tty_ldisc_hangup(tty);
 
@@ -1405,9 +1442,9 @@ static void release_one_tty(struct work_struct *work)
 	tty_driver_kref_put(driver);
 	module_put(driver->owner);
 
-	file_list_lock();
+	spin_lock(&tty_files_lock);
 	list_del_init(&tty->tty_files);
-	file_list_unlock();
+	spin_unlock(&tty_files_lock);
 
 	put_pid(tty->pgrp);
 	put_pid(tty->session);
@@ -1633,7 +1670,7 @@ void tty_release_dev(struct file *filp)
 	 *  - do_tty_hangup no longer sees this file descriptor as
 	 *    something that needs to be handled for hangups.
 	 */
-	file_kill(filp);
+	tty_del_file(filp);
 	filp->private_data = NULL;
 
 	/*
@@ -1790,8 +1827,7 @@ got_driver:
 	if (IS_ERR(tty))
 		return PTR_ERR(tty);
 
-	filp->private_data = tty;
-	file_move(filp, &tty->tty_files);
+	tty_add_file(tty, filp);
 	check_tty_count(tty, "tty_open");
 	if (tty->driver->type == TTY_DRIVER_TYPE_PTY &&
 	    tty->driver->subtype == PTY_TYPE_MASTER)
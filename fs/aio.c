@@ -32,6 +32,9 @@
 #include <linux/workqueue.h>
 #include <linux/security.h>
 #include <linux/eventfd.h>
+#include <linux/kthread.h>
+#include <linux/log2.h>
+#include <linux/poll.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -53,6 +56,13 @@ static struct kmem_cache	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
 
+/* upper limit for the submission ring size */
+#define AIO_SQ_MAX_ENTRIES	4096
+/* upper limit for the time the poll thread busy-polls an idle ring */
+#define AIO_SQ_MAX_IDLE_MS	1000
+/* how long the poll thread backs off when it cannot consume an entry */
+#define AIO_SQ_RETRY_DELAY	(HZ / 10)
+
 /* Used for rare fput completion. */
 static void aio_fput_routine(struct work_struct *);
 static DECLARE_WORK(fput_work, aio_fput_routine);
@@ -170,6 +180,47 @@ static int aio_setup_ring(struct kioctx *ctx)
 }
 
 
+/* aio_sq_stop
+ *	Stops the submission ring poll thread, if any.  Must be called
+ *	before the requests of a dying context are cancelled, so that
+ *	the thread cannot submit new ones behind our back.
+ */
+static void aio_sq_stop(struct kioctx *ctx)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+	struct task_struct *thread;
+
+	mutex_lock(&sq->lock);
+	thread = sq->thread;
+	sq->thread = NULL;
+	mutex_unlock(&sq->lock);
+
+	if (thread)
+		kthread_stop(thread);
+}
+
+static void aio_sq_free(struct kioctx *ctx)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+	unsigned i;
+
+	BUG_ON(sq->thread);
+
+	for (i = 0; i < sq->nr_files; i++)
+		fput(sq->files[i]);
+	kfree(sq->files);
+	sq->files = NULL;
+	sq->nr_files = 0;
+
+	if (sq->mmap_size) {
+		down_write(&ctx->mm->mmap_sem);
+		do_munmap(ctx->mm, sq->mmap_base, sq->mmap_size);
+		up_write(&ctx->mm->mmap_sem);
+	}
+	sq->mmap_base = sq->mmap_size = 0;
+	sq->nr = 0;
+}
+
 /* aio_ring_event: returns a pointer to the event at the given index from
  * kmap_atomic(, km).  Release the pointer with put_aio_ring_event();
  */
@@ -218,6 +269,7 @@ static void __put_ioctx(struct kioctx *ctx)
 	cancel_delayed_work(&ctx->wq);
 	cancel_work_sync(&ctx->wq.work);
 	aio_free_ring(ctx);
+	aio_sq_free(ctx);
 	mmdrop(ctx->mm);
 	ctx->mm = NULL;
 	pr_debug("__put_ioctx: freeing %p\n", ctx);
@@ -265,6 +317,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	mutex_init(&ctx->sq_info.lock);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
@@ -398,6 +451,7 @@ void exit_aio(struct mm_struct *mm)
 		ctx = hlist_entry(mm->ioctx_list.first, struct kioctx, list);
 		hlist_del_rcu(&ctx->list);
 
+		aio_sq_stop(ctx);
 		aio_cancel_all(ctx);
 
 		wait_for_all_aios(ctx);
@@ -543,6 +597,16 @@ static int __aio_put_req(struct kioctx *ctx, struct kiocb *req)
 	req->ki_cancel = NULL;
 	req->ki_retry = NULL;
 
+	/*
+	 * Fixed files are pinned by the kioctx, and requests that failed
+	 * before getting a file have none to put.
+	 */
+	if (kiocbIsFixedFile(req) || !req->ki_filp) {
+		req->ki_filp = NULL;
+		really_put_req(ctx, req);
+		return 1;
+	}
+
 	/*
 	 * Try to optimize the aio and eventfd file* puts, by avoiding to
 	 * schedule work in case it is not __fput() time. In normal cases,
@@ -764,17 +828,13 @@ static int __aio_run_iocbs(struct kioctx *ctx)
 
 static void aio_queue_work(struct kioctx * ctx)
 {
-	unsigned long timeout;
 	/*
-	 * if someone is waiting, get the work started right
-	 * away, otherwise, use a longer delay
+	 * Get the work started right away: kicked buffered reads and
+	 * polls are often reaped through an eventfd or the mmapped ring
+	 * rather than by sleeping in io_getevents(), so there may be no
+	 * waiter on ctx->wait to tell us that someone is in a hurry.
 	 */
-	smp_mb();
-	if (waitqueue_active(&ctx->wait))
-		timeout = 1;
-	else
-		timeout = HZ/10;
-	queue_delayed_work(aio_wq, &ctx->wq, timeout);
+	queue_delayed_work(aio_wq, &ctx->wq, 0);
 }
 
 
@@ -901,6 +961,7 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	struct aio_ring_info	*info;
 	struct aio_ring	*ring;
 	struct io_event	*event;
+	struct eventfd_ctx *eventfd = NULL;
 	unsigned long	flags;
 	unsigned long	tail;
 	int		ret;
@@ -971,11 +1032,13 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 
 	/*
 	 * Check if the user asked us to deliver the result through an
-	 * eventfd. The eventfd_signal() function is safe to be called
-	 * from IRQ context.
+	 * eventfd.  It is signalled once ctx_lock is dropped: the wakeup
+	 * may kick an IOCB_CMD_POLL iocb polling that eventfd, and kicking
+	 * takes the ctx_lock of that iocb's context.  The iocb may be gone
+	 * by then, so hold our own reference.
 	 */
 	if (iocb->ki_eventfd != NULL)
-		eventfd_signal(iocb->ki_eventfd, 1);
+		eventfd = eventfd_ctx_get(iocb->ki_eventfd);
 
 put_rq:
 	/* everything turned out well, dispose of the aiocb. */
@@ -993,6 +1056,12 @@ put_rq:
 		wake_up(&ctx->wait);
 
 	spin_unlock_irqrestore(&ctx->ctx_lock, flags);
+
+	/* eventfd_signal() is safe to be called from IRQ context */
+	if (eventfd) {
+		eventfd_signal(eventfd, 1);
+		eventfd_ctx_put(eventfd);
+	}
 	return ret;
 }
 EXPORT_SYMBOL(aio_complete);
@@ -1211,6 +1280,7 @@ static void io_destroy(struct kioctx *ioctx)
 	if (likely(!was_dead))
 		put_ioctx(ioctx);	/* twice for the list */
 
+	aio_sq_stop(ioctx);
 	aio_cancel_all(ioctx);
 	wait_for_all_aios(ioctx);
 
@@ -1344,6 +1414,15 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 		 (opcode == IOCB_CMD_PWRITEV ||
 		  (!S_ISFIFO(inode->i_mode) && !S_ISSOCK(inode->i_mode))));
 
+	/*
+	 * A buffered read that made progress may have stopped at a page
+	 * still under I/O, leaving the iocb queued for the page unlock:
+	 * it completes from the retry that the wakeup kicks off.
+	 */
+	if (ret != -EIOCBRETRY && ret != -EIOCBQUEUED &&
+	    !list_empty_careful(&iocb->ki_wait.task_list))
+		return -EIOCBRETRY;
+
 	/* This means we must have transferred all that we could */
 	/* No need to retry anymore */
 	if ((ret == 0) || (iocb->ki_left == 0))
@@ -1379,13 +1458,126 @@ static ssize_t aio_fsync(struct kiocb *iocb)
 	return ret;
 }
 
+/*
+ * IOCB_CMD_POLL: the iocb waits on the file's wait queue and is kicked
+ * by its wakeups.  Every retry polls the file again, which re-queues it,
+ * until one of the requested events (or an error or hangup) is reported;
+ * that mask is the result of the request.  Files that wait on more than
+ * one wait queue are not supported.
+ */
+struct aio_poll_table {
+	poll_table		pt;
+	struct kiocb		*iocb;
+	int			queued;
+	int			error;
+};
+
+static void aio_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+				poll_table *pt)
+{
+	struct aio_poll_table *apt = container_of(pt, struct aio_poll_table, pt);
+	struct kiocb *iocb = apt->iocb;
+
+	if (unlikely(apt->queued)) {
+		apt->error = -EINVAL;
+		return;
+	}
+	apt->queued = 1;
+	iocb->ki_poll.head = head;
+	add_wait_queue(head, &iocb->ki_wait);
+}
+
+static int aio_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+			 void *key)
+{
+	struct kiocb *iocb = io_wait_to_kiocb(wait);
+
+	/* wakeups that carry an event mask only count if it is one of ours */
+	if (key && !((unsigned long)key & iocb->ki_poll.events))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(iocb);
+	return 1;
+}
+
+static ssize_t aio_poll(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct aio_poll_table apt;
+	wait_queue_head_t *head;
+	unsigned mask;
+	ssize_t ret = -EIOCBRETRY;
+
+	init_poll_funcptr(&apt.pt, aio_poll_queue_proc);
+	apt.iocb = iocb;
+	apt.queued = 0;
+	apt.error = 0;
+
+	mask = file->f_op->poll(file, &apt.pt) & iocb->ki_poll.events;
+	if (unlikely(!apt.queued))
+		return mask ? mask : -EINVAL;
+
+	/* queue before testing for cancellation, see aio_poll_cancel() */
+	smp_mb();
+
+	/*
+	 * Only complete if we are the ones taking the iocb off the wait
+	 * queue: otherwise a wakeup or aio_poll_cancel() already did and
+	 * kicked it, and the retry that follows will finish the job.
+	 */
+	if (mask || apt.error || kiocbIsCancelled(iocb)) {
+		head = iocb->ki_poll.head;
+		spin_lock_irq(&head->lock);
+		if (!list_empty(&iocb->ki_wait.task_list)) {
+			list_del_init(&iocb->ki_wait.task_list);
+			if (apt.error)
+				ret = apt.error;
+			else if (mask)
+				ret = mask;
+			else
+				ret = -EINTR;
+		}
+		spin_unlock_irq(&head->lock);
+	}
+	return ret;
+}
+
+static int aio_poll_cancel(struct kiocb *iocb, struct io_event *res)
+{
+	wait_queue_head_t *head;
+	int queued = 0;
+
+	/*
+	 * A queued iocb is kicked, and the retry sees it cancelled.
+	 * Otherwise aio_poll() is running and will see the cancelled
+	 * flag once it has queued the iocb.  Either way the completion
+	 * goes through the ring, so don't report it to io_cancel().
+	 */
+	smp_mb();
+	head = iocb->ki_poll.head;
+	if (head) {
+		spin_lock_irq(&head->lock);
+		if (!list_empty(&iocb->ki_wait.task_list)) {
+			list_del_init(&iocb->ki_wait.task_list);
+			queued = 1;
+		}
+		spin_unlock_irq(&head->lock);
+	}
+	if (queued)
+		kick_iocb(iocb);
+
+	aio_put_req(iocb);
+	return -EAGAIN;
+}
+
 static ssize_t aio_setup_vectored_rw(int type, struct kiocb *kiocb)
 {
 	ssize_t ret;
 
 	ret = rw_copy_check_uvector(type, (struct iovec __user *)kiocb->ki_buf,
 				    kiocb->ki_nbytes, 1,
-				    &kiocb->ki_inline_vec, &kiocb->ki_iovec);
+				    &kiocb->ki_inline_vec, &kiocb->ki_iovec, 1);
 	if (ret < 0)
 		goto out;
 
@@ -1495,6 +1687,20 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb)
 		if (file->f_op->aio_fsync)
 			kiocb->ki_retry = aio_fsync;
 		break;
+	case IOCB_CMD_POLL:
+		/* the requested events are passed in aio_buf */
+		ret = -EINVAL;
+		if (unlikely(kiocb->ki_nbytes || kiocb->ki_pos))
+			break;
+		if (unlikely(!file->f_op->poll))
+			break;
+		kiocb->ki_poll.head = NULL;
+		kiocb->ki_poll.events = (unsigned long)kiocb->ki_buf |
+					POLLERR | POLLHUP;
+		kiocb->ki_wait.func = aio_poll_wake;
+		kiocb->ki_cancel = aio_poll_cancel;
+		kiocb->ki_retry = aio_poll;
+		break;
 	default:
 		dprintk("EINVAL: io_submit: no operation provided\n");
 		ret = -EINVAL;
@@ -1531,6 +1737,20 @@ static int aio_wake_function(wait_queue_t *wait, unsigned mode,
 	return 1;
 }
 
+/* aio_fixed_file
+ *	Returns the file registered at the given index with io_setup_sq(),
+ *	or NULL.  The kioctx holds the reference until it is freed.
+ */
+static struct file *aio_fixed_file(struct kioctx *ctx, unsigned index)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+
+	if (index >= ACCESS_ONCE(sq->nr_files))
+		return NULL;
+	smp_rmb();	/* pairs with smp_wmb() in sys_io_setup_sq() */
+	return sq->files[index];
+}
+
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 			 struct iocb *iocb)
 {
@@ -1554,16 +1774,28 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 		return -EINVAL;
 	}
 
-	file = fget(iocb->aio_fildes);
+	/*
+	 * The submission ring poll thread is a kernel thread, it has no
+	 * file table to look descriptors up in.
+	 */
+	if (iocb->aio_flags & IOCB_FLAG_FIXED_FILE)
+		file = aio_fixed_file(ctx, iocb->aio_fildes);
+	else if (unlikely(current->flags & PF_KTHREAD))
+		file = NULL;
+	else
+		file = fget(iocb->aio_fildes);
 	if (unlikely(!file))
 		return -EBADF;
 
 	req = aio_get_req(ctx);		/* returns with 2 references to req */
 	if (unlikely(!req)) {
-		fput(file);
+		if (!(iocb->aio_flags & IOCB_FLAG_FIXED_FILE))
+			fput(file);
 		return -EAGAIN;
 	}
 	req->ki_filp = file;
+	if (iocb->aio_flags & IOCB_FLAG_FIXED_FILE)
+		kiocbSetFixedFile(req);
 	if (iocb->aio_flags & IOCB_FLAG_RESFD) {
 		/*
 		 * If the IOCB_FLAG_RESFD flag of aio_flags is set, get an
@@ -1571,6 +1803,9 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 		 * an eventfd() fd, and will be signaled for each completed
 		 * event using the eventfd_signal() function.
 		 */
+		ret = -EINVAL;
+		if (unlikely(current->flags & PF_KTHREAD))
+			goto out_put_req;
 		req->ki_eventfd = eventfd_ctx_fdget((int) iocb->aio_resfd);
 		if (IS_ERR(req->ki_eventfd)) {
 			ret = PTR_ERR(req->ki_eventfd);
@@ -1678,6 +1913,309 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 	return i ? i : ret;
 }
 
+/* aio_sq_fail
+ *	Completes a submission ring entry that could not be submitted,
+ *	so that the error reaches the application through the completion
+ *	ring.  Returns -EAGAIN if the completion ring is full, in which
+ *	case the entry must stay queued.
+ */
+static int aio_sq_fail(struct kioctx *ctx, struct iocb __user *user_iocb,
+		       struct iocb *iocb, long res)
+{
+	struct kiocb *req;
+
+	req = aio_get_req(ctx);
+	if (unlikely(!req))
+		return -EAGAIN;
+
+	req->ki_filp = NULL;
+	req->ki_obj.user = user_iocb;
+	req->ki_user_data = iocb->aio_data;
+	aio_complete(req, res, 0);
+	aio_put_req(req);	/* drop extra ref to req */
+	return 0;
+}
+
+/* aio_sq_submit
+ *	Submits up to to_submit entries from the submission ring and
+ *	releases them to the application.  Returns the number of entries
+ *	consumed, or an error if none could be.  Called with sq->lock
+ *	held, in the context of the ring's mm.
+ */
+static int aio_sq_submit(struct kioctx *ctx, unsigned to_submit)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+	struct aio_sq_ring __user *ring = (void __user *)sq->mmap_base;
+	unsigned head = sq->head, tail;
+	int i = 0, ret = 0;
+
+	if (unlikely(get_user(tail, &ring->tail)))
+		return -EFAULT;
+	if (unlikely(tail - head > sq->nr))
+		return -EINVAL;
+	smp_rmb();	/* read the entries only after reading the tail */
+
+	while (i < to_submit && head != tail) {
+		struct iocb __user *user_iocb;
+		struct iocb tmp;
+
+		user_iocb = &ring->iocbs[head & (sq->nr - 1)];
+		if (unlikely(copy_from_user(&tmp, user_iocb, sizeof(tmp)))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		ret = io_submit_one(ctx, user_iocb, &tmp);
+		if (unlikely(ret))
+			ret = aio_sq_fail(ctx, user_iocb, &tmp, ret);
+		if (ret)
+			break;
+
+		head++;
+		i++;
+	}
+
+	if (i) {
+		smp_mb();	/* finish reading the entries before releasing them */
+		sq->head = head;
+		if (unlikely(put_user(head, &ring->head)))
+			return -EFAULT;
+	}
+	return i ? i : ret;
+}
+
+/*
+ * aio_sq_thread:
+ *	Submission ring poll thread (AIO_SQ_POLL).  Submits whatever the
+ *	application queues, in its mm, and goes to sleep after sq->idle
+ *	jiffies without work, setting AIO_SQ_NEED_WAKEUP in the ring so
+ *	that the application knows it has to call io_sq_enter().  When an
+ *	entry cannot be consumed (full completion ring, bogus tail) it
+ *	sleeps as well, and retries after AIO_SQ_RETRY_DELAY.
+ */
+static int aio_sq_thread(void *data)
+{
+	struct kioctx *ctx = data;
+	struct aio_sq_info *sq = &ctx->sq_info;
+	struct aio_sq_ring __user *ring = (void __user *)sq->mmap_base;
+	unsigned long timeout = jiffies + sq->idle;
+	mm_segment_t oldfs = get_fs();
+	unsigned flags, tail;
+	int ret;
+
+	set_fs(USER_DS);
+	use_mm(ctx->mm);
+
+	while (!kthread_should_stop()) {
+		mutex_lock(&sq->lock);
+		ret = aio_sq_submit(ctx, sq->nr);
+		mutex_unlock(&sq->lock);
+
+		if (ret > 0)
+			timeout = jiffies + sq->idle;
+		if (ret > 0 || (!ret && time_before(jiffies, timeout))) {
+			cond_resched();
+			continue;
+		}
+
+		if (!get_user(flags, &ring->flags))
+			put_user(flags | AIO_SQ_NEED_WAKEUP, &ring->flags);
+		/* order the flag store against the tail recheck */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop()) {
+			if (ret < 0)
+				schedule_timeout(AIO_SQ_RETRY_DELAY);
+			else if (get_user(tail, &ring->tail) ||
+				 tail == sq->head)
+				schedule();
+		}
+		__set_current_state(TASK_RUNNING);
+		if (!get_user(flags, &ring->flags))
+			put_user(flags & ~AIO_SQ_NEED_WAKEUP, &ring->flags);
+
+		timeout = jiffies + sq->idle;
+	}
+
+	unuse_mm(ctx->mm);
+	set_fs(oldfs);
+	return 0;
+}
+
+/* sys_io_setup_sq:
+ *	Sets up a submission ring for the aio_context specified by ctx_id,
+ *	mapped into the calling process, and optionally registers fixed
+ *	files and starts a poll thread (see struct aio_sq_params).  On
+ *	success the ring address is stored in params->ring.  May fail
+ *	with -EINVAL if ctx_id is invalid or the parameters are out of
+ *	range, with -EPERM if AIO_SQ_POLL is requested without
+ *	CAP_SYS_ADMIN, with -EBUSY if the context already has a ring, with
+ *	-EBADF if one of the files is invalid and with -EFAULT if any of
+ *	the data structures point to invalid data.
+ */
+SYSCALL_DEFINE2(io_setup_sq, aio_context_t, ctx_id,
+		struct aio_sq_params __user *, params)
+{
+	const __s32 __user *fds;
+	struct aio_sq_params p;
+	struct aio_sq_ring __user *ring;
+	struct task_struct *thread = NULL;
+	struct file **files = NULL;
+	struct aio_sq_info *sq;
+	struct kioctx *ctx;
+	unsigned long size;
+	unsigned nr, i = 0;
+	long ret;
+
+	if (unlikely(copy_from_user(&p, params, sizeof(p))))
+		return -EFAULT;
+
+	if (unlikely(p.flags & ~AIO_SQ_POLL))
+		return -EINVAL;
+	if (unlikely(!p.nr_entries || p.nr_entries > AIO_SQ_MAX_ENTRIES))
+		return -EINVAL;
+	if (unlikely(p.nr_files > current->signal->rlim[RLIMIT_NOFILE].rlim_cur))
+		return -EINVAL;
+	/* the poll thread can only use fixed files */
+	if (unlikely((p.flags & AIO_SQ_POLL) && !p.nr_files))
+		return -EINVAL;
+	/* a poll thread burns CPU time that is not charged to the caller */
+	if ((p.flags & AIO_SQ_POLL) && !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx))
+		return -EINVAL;
+	sq = &ctx->sq_info;
+
+	mutex_lock(&sq->lock);
+	ret = -EINVAL;
+	if (unlikely(ctx->dead))
+		goto out_unlock;
+	ret = -EBUSY;
+	if (sq->mmap_base)
+		goto out_unlock;
+
+	if (p.nr_files) {
+		fds = (const __s32 __user *)(unsigned long)p.files;
+		ret = -ENOMEM;
+		files = kcalloc(p.nr_files, sizeof(*files), GFP_KERNEL);
+		if (!files)
+			goto out_unlock;
+
+		for (i = 0; i < p.nr_files; i++) {
+			__s32 fd;
+
+			ret = -EFAULT;
+			if (get_user(fd, fds + i))
+				goto out_files;
+			ret = -EBADF;
+			files[i] = fget(fd);
+			if (!files[i])
+				goto out_files;
+		}
+	}
+
+	nr = roundup_pow_of_two(p.nr_entries);
+	size = PAGE_ALIGN(sizeof(struct aio_sq_ring) + nr * sizeof(struct iocb));
+	down_write(&ctx->mm->mmap_sem);
+	ring = (void __user *)do_mmap(NULL, 0, size, PROT_READ|PROT_WRITE,
+				      MAP_ANONYMOUS|MAP_PRIVATE, 0);
+	up_write(&ctx->mm->mmap_sem);
+	ret = -EAGAIN;
+	if (IS_ERR((void __force *)ring))
+		goto out_files;
+
+	/* head, tail and flags start out as zero in the fresh mapping */
+	ret = -EFAULT;
+	p.ring = (unsigned long)ring;
+	if (put_user(nr, &ring->nr) ||
+	    put_user(AIO_SQ_RING_MAGIC, &ring->magic) ||
+	    put_user(sizeof(struct aio_sq_ring), &ring->header_length) ||
+	    copy_to_user(params, &p, sizeof(p)))
+		goto out_unmap;
+
+	if (p.flags & AIO_SQ_POLL) {
+		sq->idle = msecs_to_jiffies(p.idle_ms ?
+				min_t(__u32, p.idle_ms, AIO_SQ_MAX_IDLE_MS) :
+				1000);
+		thread = kthread_create(aio_sq_thread, ctx, "aio_sq/%d",
+					task_pid_nr(current));
+		if (IS_ERR(thread)) {
+			ret = PTR_ERR(thread);
+			goto out_unmap;
+		}
+	}
+
+	sq->mmap_base = (unsigned long)ring;
+	sq->mmap_size = size;
+	sq->nr = nr;
+	sq->head = 0;
+	sq->files = files;
+	smp_wmb();	/* pairs with smp_rmb() in aio_fixed_file() */
+	sq->nr_files = p.nr_files;
+
+	if (thread) {
+		sq->thread = thread;
+		wake_up_process(thread);
+	}
+
+	mutex_unlock(&sq->lock);
+	put_ioctx(ctx);
+	return 0;
+
+out_unmap:
+	down_write(&ctx->mm->mmap_sem);
+	do_munmap(ctx->mm, (unsigned long)ring, size);
+	up_write(&ctx->mm->mmap_sem);
+out_files:
+	while (i--)
+		fput(files[i]);
+	kfree(files);
+out_unlock:
+	mutex_unlock(&sq->lock);
+	put_ioctx(ctx);
+	return ret;
+}
+
+/* sys_io_sq_enter:
+ *	Submits up to to_submit entries queued on the submission ring of
+ *	the aio_context specified by ctx_id and returns the number of
+ *	entries consumed.  If the ring has a poll thread, nothing is
+ *	submitted, and AIO_SQ_ENTER_WAKEUP in flags wakes the thread up.
+ *	May fail with -EINVAL if ctx_id is invalid or the context has no
+ *	submission ring, with -EAGAIN if the completion ring is full and
+ *	with -EFAULT if the ring is not accessible.
+ */
+SYSCALL_DEFINE3(io_sq_enter, aio_context_t, ctx_id, unsigned int, to_submit,
+		unsigned int, flags)
+{
+	struct aio_sq_info *sq;
+	struct kioctx *ctx;
+	long ret;
+
+	if (unlikely(flags & ~AIO_SQ_ENTER_WAKEUP))
+		return -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx))
+		return -EINVAL;
+	sq = &ctx->sq_info;
+
+	mutex_lock(&sq->lock);
+	if (unlikely(!sq->mmap_base))
+		ret = -EINVAL;
+	else if (sq->thread) {
+		if (flags & AIO_SQ_ENTER_WAKEUP)
+			wake_up_process(sq->thread);
+		ret = 0;
+	} else
+		ret = aio_sq_submit(ctx, to_submit);
+	mutex_unlock(&sq->lock);
+
+	put_ioctx(ctx);
+	return ret;
+}
+
 /* lookup_kiocb
  *	Finds a given iocb for cancellation.
  */
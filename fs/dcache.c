@@ -107,6 +107,7 @@ static void dentry_iput(struct dentry * dentry)
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
 		dentry->d_inode = NULL;
+		dentry_rcuwalk_barrier(dentry);
 		list_del_init(&dentry->d_alias);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -122,29 +123,65 @@ static void dentry_iput(struct dentry * dentry)
 	}
 }
 
+/*
+ * Unused dentries are kept on per-superblock LRUs, split by the node the
+ * dentry was allocated on, so that reclaim on one node does not throw out
+ * the dcache of the others.  dentry_unused_node[] counts the unused
+ * dentries of each node over all superblocks.
+ */
+static int dentry_unused_node[MAX_NUMNODES];
+
+static inline int dentry_nid(struct dentry *dentry)
+{
+	return page_to_nid(virt_to_page(dentry));
+}
+
+static inline struct dentry_lru *dentry_lru(struct dentry *dentry, int *nid)
+{
+	*nid = dentry_nid(dentry);
+	return &dentry->d_sb->s_dentry_lru[*nid];
+}
+
 /*
  * dentry_lru_(add|add_tail|del|del_init) must be called with dcache_lock held.
  */
 static void dentry_lru_add(struct dentry *dentry)
 {
-	list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
+	int nid;
+	struct dentry_lru *lru = dentry_lru(dentry, &nid);
+
+	list_add(&dentry->d_lru, &lru->list);
+	lru->nr_unused++;
+	dentry_unused_node[nid]++;
 	dentry_stat.nr_unused++;
 }
 
 static void dentry_lru_add_tail(struct dentry *dentry)
 {
-	list_add_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
+	int nid;
+	struct dentry_lru *lru = dentry_lru(dentry, &nid);
+
+	list_add_tail(&dentry->d_lru, &lru->list);
+	lru->nr_unused++;
+	dentry_unused_node[nid]++;
 	dentry_stat.nr_unused++;
 }
 
+static void __dentry_lru_del_count(struct dentry *dentry)
+{
+	int nid;
+	struct dentry_lru *lru = dentry_lru(dentry, &nid);
+
+	lru->nr_unused--;
+	dentry_unused_node[nid]--;
+	dentry_stat.nr_unused--;
+}
+
 static void dentry_lru_del(struct dentry *dentry)
 {
 	if (!list_empty(&dentry->d_lru)) {
 		list_del(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		__dentry_lru_del_count(dentry);
 	}
 }
 
@@ -152,8 +189,7 @@ static void dentry_lru_del_init(struct dentry *dentry)
 {
 	if (likely(!list_empty(&dentry->d_lru))) {
 		list_del_init(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		__dentry_lru_del_count(dentry);
 	}
 }
 
@@ -446,13 +482,16 @@ static void prune_one_dentry(struct dentry * dentry)
 /*
  * Shrink the dentry LRU on a given superblock.
  * @sb   : superblock to shrink dentry LRU.
- * @count: If count is NULL, we prune all dentries on superblock.
+ * @nid  : node whose LRU to shrink.
+ * @count: If count is NULL, we prune all dentries of the node on superblock.
  * @flags: If flags is non-zero, we need to do special processing based on
  * which flags are set. This means we don't need to maintain multiple
  * similar copies of this loop.
  */
-static void __shrink_dcache_sb(struct super_block *sb, int *count, int flags)
+static void __shrink_dcache_sb(struct super_block *sb, int nid, int *count,
+			       int flags)
 {
+	struct list_head *lru = &sb->s_dentry_lru[nid].list;
 	LIST_HEAD(referenced);
 	LIST_HEAD(tmp);
 	struct dentry *dentry;
@@ -466,11 +505,10 @@ static void __shrink_dcache_sb(struct super_block *sb, int *count, int flags)
 		cnt = *count;
 restart:
 	if (count == NULL)
-		list_splice_init(&sb->s_dentry_lru, &tmp);
+		list_splice_init(lru, &tmp);
 	else {
-		while (!list_empty(&sb->s_dentry_lru)) {
-			dentry = list_entry(sb->s_dentry_lru.prev,
-					struct dentry, d_lru);
+		while (!list_empty(lru)) {
+			dentry = list_entry(lru->prev, struct dentry, d_lru);
 			BUG_ON(dentry->d_sb != sb);
 
 			spin_lock(&dentry->d_lock);
@@ -511,17 +549,18 @@ restart:
 		/* dentry->d_lock was dropped in prune_one_dentry() */
 		cond_resched_lock(&dcache_lock);
 	}
-	if (count == NULL && !list_empty(&sb->s_dentry_lru))
+	if (count == NULL && !list_empty(lru))
 		goto restart;
 	if (count != NULL)
 		*count = cnt;
 	if (!list_empty(&referenced))
-		list_splice(&referenced, &sb->s_dentry_lru);
+		list_splice(&referenced, lru);
 	spin_unlock(&dcache_lock);
 }
 
 /**
- * prune_dcache - shrink the dcache
+ * prune_dcache - shrink the dcache on one node
+ * @nid: node whose dentries to free
  * @count: number of entries to try to free
  *
  * Shrink the dcache. This is done when we need more memory, or simply when we
@@ -529,11 +568,11 @@ restart:
  *
  * This function may fail to free any resources if all the dentries are in use.
  */
-static void prune_dcache(int count)
+static void prune_dcache(int nid, int count)
 {
 	struct super_block *sb;
 	int w_count;
-	int unused = dentry_stat.nr_unused;
+	int unused = dentry_unused_node[nid];
 	int prune_ratio;
 	int pruned;
 
@@ -547,7 +586,7 @@ restart:
 		prune_ratio = unused / count;
 	spin_lock(&sb_lock);
 	list_for_each_entry(sb, &super_blocks, s_list) {
-		if (sb->s_nr_dentry_unused == 0)
+		if (sb->s_dentry_lru[nid].nr_unused == 0)
 			continue;
 		sb->s_count++;
 		/* Now, we reclaim unused dentrins with fairness.
@@ -557,13 +596,14 @@ restart:
 		 * overflows:
 		 * number of dentries to scan on this sb =
 		 * count * (number of dentries on this sb /
-		 * number of dentries in the machine)
+		 * number of dentries on the node)
 		 */
 		spin_unlock(&sb_lock);
 		if (prune_ratio != 1)
-			w_count = (sb->s_nr_dentry_unused / prune_ratio) + 1;
+			w_count = (sb->s_dentry_lru[nid].nr_unused /
+				   prune_ratio) + 1;
 		else
-			w_count = sb->s_nr_dentry_unused;
+			w_count = sb->s_dentry_lru[nid].nr_unused;
 		pruned = w_count;
 		/*
 		 * We need to be sure this filesystem isn't being unmounted,
@@ -574,9 +614,9 @@ restart:
 		 */
 		if (down_read_trylock(&sb->s_umount)) {
 			if ((sb->s_root != NULL) &&
-			    (!list_empty(&sb->s_dentry_lru))) {
+			    (!list_empty(&sb->s_dentry_lru[nid].list))) {
 				spin_unlock(&dcache_lock);
-				__shrink_dcache_sb(sb, &w_count,
+				__shrink_dcache_sb(sb, nid, &w_count,
 						DCACHE_REFERENCED);
 				pruned -= w_count;
 				spin_lock(&dcache_lock);
@@ -608,7 +648,10 @@ restart:
  */
 void shrink_dcache_sb(struct super_block * sb)
 {
-	__shrink_dcache_sb(sb, NULL, 0);
+	int nid;
+
+	for_each_node(nid)
+		__shrink_dcache_sb(sb, nid, NULL, 0);
 }
 
 /*
@@ -795,10 +838,10 @@ positive:
 
 /*
  * Search the dentry child list for the specified parent,
- * and move any unused dentries to the end of the unused
- * list for prune_dcache(). We descend to the next level
- * whenever the d_subdirs list is non-empty and continue
- * searching.
+ * and move any unused dentries allocated on node @nid to the
+ * end of that node's unused list for prune_dcache(). We descend
+ * to the next level whenever the d_subdirs list is non-empty and
+ * continue searching.
  *
  * It returns zero iff there are no unused children,
  * otherwise  it returns the number of children moved to
@@ -807,7 +850,7 @@ positive:
  * drop the lock and return early due to latency
  * constraints.
  */
-static int select_parent(struct dentry * parent)
+static int select_parent(struct dentry * parent, int nid)
 {
 	struct dentry *this_parent = parent;
 	struct list_head *next;
@@ -822,6 +865,9 @@ resume:
 		struct dentry *dentry = list_entry(tmp, struct dentry, d_u.d_child);
 		next = tmp->next;
 
+		if (dentry_nid(dentry) != nid)
+			goto descend;
+
 		dentry_lru_del_init(dentry);
 		/* 
 		 * move only zero ref count dentries to the end 
@@ -839,7 +885,7 @@ resume:
 		 */
 		if (found && need_resched())
 			goto out;
-
+descend:
 		/*
 		 * Descend a level if the d_subdirs list is non-empty.
 		 */
@@ -871,10 +917,19 @@ out:
 void shrink_dcache_parent(struct dentry * parent)
 {
 	struct super_block *sb = parent->d_sb;
-	int found;
+	int found, nid;
 
-	while ((found = select_parent(parent)) != 0)
-		__shrink_dcache_sb(sb, &found, 0);
+	/*
+	 * Go node by node, so that exactly the children select_parent()
+	 * moved to the tail of a node's LRU are pruned from it.  Ancestors
+	 * on other nodes that become unused go with their last child.
+	 */
+	for_each_node(nid) {
+		if (!sb->s_dentry_lru[nid].nr_unused)
+			continue;
+		while ((found = select_parent(parent, nid)) != 0)
+			__shrink_dcache_sb(sb, nid, &found, 0);
+	}
 }
 
 /*
@@ -891,16 +946,37 @@ void shrink_dcache_parent(struct dentry * parent)
  */
 static int shrink_dcache_memory(int nr, gfp_t gfp_mask)
 {
+	int nid, unused;
+
 	if (nr) {
 		if (!(gfp_mask & __GFP_FS))
 			return -1;
-		prune_dcache(nr);
+		/* Take from every node in proportion to its unused dentries */
+		unused = dentry_stat.nr_unused;
+		for_each_node(nid) {
+			if (!unused)
+				break;
+			if (dentry_unused_node[nid])
+				prune_dcache(nid, div_u64((u64)nr *
+					dentry_unused_node[nid], unused) + 1);
+		}
 	}
 	return (dentry_stat.nr_unused / 100) * sysctl_vfs_cache_pressure;
 }
 
+static int shrink_dcache_memory_node(int nr, gfp_t gfp_mask, int nid)
+{
+	if (nr) {
+		if (!(gfp_mask & __GFP_FS))
+			return -1;
+		prune_dcache(nid, nr);
+	}
+	return (dentry_unused_node[nid] / 100) * sysctl_vfs_cache_pressure;
+}
+
 static struct shrinker dcache_shrinker = {
 	.shrink = shrink_dcache_memory,
+	.shrink_node = shrink_dcache_memory_node,
 	.seeks = DEFAULT_SEEKS,
 };
 
@@ -942,6 +1018,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
@@ -1421,6 +1498,54 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking references
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seq: returns the d_seq value of the found dentry
+ *
+ * Like __d_lookup(), but takes neither d_lock nor a reference on the
+ * dentry it finds. The caller must hold rcu_read_lock() and must not
+ * trust anything read from the returned dentry until it has rechecked
+ * @seq with read_seqcount_retry() or __d_rcu_to_refcount(). Parents
+ * with a ->d_compare() method are not handled here.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
+				unsigned *seq)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		unsigned int tlen;
+		const unsigned char *tname;
+		unsigned s;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+seqretry:
+		s = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		tlen = dentry->d_name.len;
+		tname = dentry->d_name.name;
+		/* d_move() may be switching the name under us */
+		if (read_seqcount_retry(&dentry->d_seq, s))
+			goto seqretry;
+		if (tlen != len || memcmp(tname, str, len))
+			continue;
+		*seq = s;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1650,6 +1775,12 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
+	/* Unhash the target: dput() will then get rid of it */
+	__d_drop(target);
+
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&target->d_seq);
+
 	/* Move the dentry to the target hash queue, if on different bucket */
 	if (d_unhashed(dentry))
 		goto already_unhashed;
@@ -1660,9 +1791,6 @@ already_unhashed:
 	list = d_hash(target->d_parent, target->d_name.hash);
 	__d_rehash(dentry, list);
 
-	/* Unhash the target: dput() will then get rid of it */
-	__d_drop(target);
-
 	list_del(&dentry->d_u.d_child);
 	list_del(&target->d_u.d_child);
 
@@ -1683,6 +1811,10 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
+
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1776,6 +1908,7 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 {
 	struct dentry *dparent, *aparent;
 
+	write_seqcount_begin(&anon->d_seq);
 	switch_names(dentry, anon);
 	swap(dentry->d_name.hash, anon->d_name.hash);
 
@@ -1797,6 +1930,7 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 		INIT_LIST_HEAD(&anon->d_u.d_child);
 
 	anon->d_flags &= ~DCACHE_DISCONNECTED;
+	write_seqcount_end(&anon->d_seq);
 }
 
 /**
@@ -1912,7 +2046,7 @@ char *__d_path(const struct path *path, struct path *root,
 	char *end = buffer + buflen;
 	char *retval;
 
-	spin_lock(&vfsmount_lock);
+	br_read_lock(vfsmount_lock);
 	prepend(&end, &buflen, "\0", 1);
 	if (d_unlinked(dentry) &&
 		(prepend(&end, &buflen, " (deleted)", 10) != 0))
@@ -1948,7 +2082,7 @@ char *__d_path(const struct path *path, struct path *root,
 	}
 
 out:
-	spin_unlock(&vfsmount_lock);
+	br_read_unlock(vfsmount_lock);
 	return retval;
 
 global_root:
@@ -466,6 +466,42 @@ ok:
 	return security_inode_permission(inode, MAY_EXEC);
 }
 
+/*
+ * exec_permission_rcu - MAY_EXEC check for the RCU path walk
+ *
+ * Like exec_permission_lite(), but may neither sleep nor rely on a
+ * reference to the inode.  Only the plain DAC case and an ACL known to
+ * be absent are decided here; -ECHILD asks for the ref-walk to decide.
+ */
+static int exec_permission_rcu(struct inode *inode)
+{
+	umode_t mode = inode->i_mode;
+
+	if (inode->i_op->permission)
+		return -ECHILD;
+
+	if (current_fsuid() == inode->i_uid)
+		mode >>= 6;
+	else {
+		if (IS_POSIXACL(inode) && (mode & S_IRWXG) &&
+		    inode->i_op->check_acl) {
+#ifdef CONFIG_FS_POSIX_ACL
+			if (inode->i_acl != NULL)
+				return -ECHILD;
+#else
+			return -ECHILD;
+#endif
+		}
+		if (in_group_p(inode->i_gid))
+			mode >>= 3;
+	}
+
+	/* capable() may sleep in the LSM; leave overrides to the ref-walk */
+	if (!(mode & MAY_EXEC))
+		return -ECHILD;
+	return security_inode_permission_rcu(inode, MAY_EXEC);
+}
+
 /*
  * This is called when everything else fails, and we actually have
  * to go to the low-level filesystem to find out what we should do..
@@ -686,15 +722,15 @@ int follow_up(struct path *path)
 {
 	struct vfsmount *parent;
 	struct dentry *mountpoint;
-	spin_lock(&vfsmount_lock);
+	br_read_lock(vfsmount_lock);
 	parent = path->mnt->mnt_parent;
 	if (parent == path->mnt) {
-		spin_unlock(&vfsmount_lock);
+		br_read_unlock(vfsmount_lock);
 		return 0;
 	}
 	mntget(parent);
 	mountpoint = dget(path->mnt->mnt_mountpoint);
-	spin_unlock(&vfsmount_lock);
+	br_read_unlock(vfsmount_lock);
 	dput(path->dentry);
 	path->dentry = mountpoint;
 	mntput(path->mnt);
@@ -773,15 +809,15 @@ static __always_inline void follow_dotdot(struct nameidata *nd)
 			break;
 		}
 		spin_unlock(&dcache_lock);
-		spin_lock(&vfsmount_lock);
+		br_read_lock(vfsmount_lock);
 		parent = nd->path.mnt->mnt_parent;
 		if (parent == nd->path.mnt) {
-			spin_unlock(&vfsmount_lock);
+			br_read_unlock(vfsmount_lock);
 			break;
 		}
 		mntget(parent);
 		nd->path.dentry = dget(nd->path.mnt->mnt_mountpoint);
-		spin_unlock(&vfsmount_lock);
+		br_read_unlock(vfsmount_lock);
 		dput(old);
 		mntput(nd->path.mnt);
 		nd->path.mnt = parent;
@@ -1026,10 +1062,182 @@ return_err:
 	return err;
 }
 
-static int path_walk(const char *name, struct nameidata *nd)
+/*
+ * RCU path walk.
+ *
+ * Most lookups resolve entirely through the dcache, yet the ref-walk in
+ * __link_path_walk() takes and drops d_lock and a reference on every
+ * dentry along the way, bouncing the cachelines of the shared upper
+ * directories between CPUs.  With LOOKUP_RCU, path_init() instead takes
+ * rcu_read_lock() and only samples the starting dentry's d_seq; each
+ * component is then found with __d_lookup_rcu() and validated against
+ * the d_seq of both the child and its parent, so that a concurrent
+ * rename, unlink or d_drop() is noticed.  Only the dentry we finish on
+ * is turned into a real reference, by nameidata_drop_rcu().
+ *
+ * Anything the lockless walk cannot decide safely - "..", symlinks,
+ * mountpoints, ->d_revalidate(), ->d_hash(), ->permission(), a cache
+ * miss - hands the walk over to the ref-walk at that component.  If the
+ * dentries changed under us, the whole walk is redone from path_init()
+ * in ref-walk mode.  Inodes looked at this way must not be freed before
+ * an RCU grace period, so only superblocks using the generic inode
+ * cache or flagged FS_RCU_INODES take part.
+ */
+static int path_init_rcu(struct path *path, struct nameidata *nd)
 {
-	current->total_link_count = 0;
-	return link_path_walk(name, nd);
+	struct dentry *dentry = path->dentry;
+	struct super_block *sb = dentry->d_sb;
+
+	if (sb->s_op->destroy_inode &&
+	    !(sb->s_type->fs_flags & FS_RCU_INODES))
+		return -ECHILD;
+	if (sb->s_type->fs_flags & FS_REVAL_DOT)
+		return -ECHILD;
+	/* unhashed dentries may be freed without waiting for RCU */
+	if (d_unhashed(dentry) && dentry != path->mnt->mnt_root)
+		return -ECHILD;
+
+	nd->path.mnt = mntget(path->mnt);
+	nd->path.dentry = dentry;
+	rcu_read_lock();
+	nd->seq = read_seqcount_begin(&dentry->d_seq);
+	return 0;
+}
+
+/*
+ * Leave RCU mode, turning nd->path.dentry into a referenced dentry.
+ * On failure nd->path.dentry is left unreferenced and -ECHILD returned;
+ * the caller still owns the reference on nd->path.mnt.
+ */
+static int nameidata_drop_rcu(struct nameidata *nd)
+{
+	struct dentry *dentry = nd->path.dentry;
+	int ok;
+
+	spin_lock(&dentry->d_lock);
+	ok = __d_rcu_to_refcount(dentry, nd->seq);
+	spin_unlock(&dentry->d_lock);
+	rcu_read_unlock();
+	nd->flags &= ~LOOKUP_RCU;
+	return ok ? 0 : -ECHILD;
+}
+
+/*
+ * Returns 0 with nd->path referenced when the whole name was resolved,
+ * 1 with nd->path referenced and *pname pointing at the first component
+ * left for the ref-walk, or -ECHILD if the walk must be restarted.
+ */
+static int path_walk_rcu(const char **pname, struct nameidata *nd)
+{
+	const char *name = *pname;
+	const char *start;
+	unsigned int lookup_flags = nd->flags;
+	struct dentry *parent = nd->path.dentry;
+	struct inode *inode;
+
+	while (*name == '/')
+		name++;
+	start = name;
+	if (!*name)
+		goto done;
+
+	inode = parent->d_inode;
+	if (!inode)
+		goto restart;
+
+	for (;;) {
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+		struct dentry *dentry;
+		unsigned seq;
+		int last;
+
+		start = name;
+		nd->flags |= LOOKUP_CONTINUE;
+		if (exec_permission_rcu(inode))
+			goto handoff;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		last = !c;
+		if (!last) {
+			while (*++name == '/');
+			if (!*name)
+				goto handoff;
+		}
+
+		if (this.name[0] == '.' &&
+		    (this.len == 1 || (this.len == 2 && this.name[1] == '.'))) {
+			if (this.len == 2 || last)
+				goto handoff;
+			continue;
+		}
+
+		if (last && (lookup_flags & LOOKUP_PARENT)) {
+			nd->flags &= lookup_flags | ~LOOKUP_CONTINUE;
+			nd->last = this;
+			nd->last_type = LAST_NORM;
+			goto done;
+		}
+
+		if (parent->d_op &&
+		    (parent->d_op->d_hash || parent->d_op->d_compare))
+			goto handoff;
+		dentry = __d_lookup_rcu(parent, &this, &seq);
+		if (!dentry)
+			goto handoff;
+		if (dentry->d_op && dentry->d_op->d_revalidate)
+			goto handoff;
+		if (d_mountpoint(dentry))
+			goto handoff;
+		inode = dentry->d_inode;
+		if (read_seqcount_retry(&dentry->d_seq, seq))
+			goto handoff;
+		if (!inode)
+			goto handoff;
+		if (last) {
+			if (follow_on_final(inode, lookup_flags))
+				goto handoff;
+			if ((lookup_flags & LOOKUP_DIRECTORY) &&
+			    !inode->i_op->lookup)
+				goto handoff;
+		} else if (inode->i_op->follow_link || !inode->i_op->lookup)
+			goto handoff;
+
+		/* dentry is only our child if parent did not move meanwhile */
+		if (read_seqcount_retry(&parent->d_seq, nd->seq))
+			goto restart;
+		nd->path.dentry = parent = dentry;
+		nd->seq = seq;
+
+		if (last) {
+			nd->flags &= lookup_flags | ~LOOKUP_CONTINUE;
+			goto done;
+		}
+	}
+
+done:
+	return nameidata_drop_rcu(nd);
+handoff:
+	*pname = start;
+	if (nameidata_drop_rcu(nd))
+		return -ECHILD;
+	return 1;
+restart:
+	rcu_read_unlock();
+	nd->flags &= ~LOOKUP_RCU;
+	return -ECHILD;
 }
 
 static int path_init(int dfd, const char *name, unsigned int flags, struct nameidata *nd)
@@ -1043,6 +1251,18 @@ static int path_init(int dfd, const char *name, unsigned int flags, struct namei
 	nd->depth = 0;
 	nd->root.mnt = NULL;
 
+	if ((flags & LOOKUP_RCU) && (*name == '/' || dfd == AT_FDCWD)) {
+		struct fs_struct *fs = current->fs;
+
+		read_lock(&fs->lock);
+		retval = path_init_rcu(*name == '/' ? &fs->root : &fs->pwd, nd);
+		read_unlock(&fs->lock);
+		if (!retval)
+			return 0;
+		retval = 0;
+	}
+	nd->flags &= ~LOOKUP_RCU;
+
 	if (*name=='/') {
 		set_root(nd);
 		nd->path = nd->root;
@@ -1084,11 +1304,43 @@ out_fail:
 	return retval;
 }
 
+static int path_walk(const char *name, struct nameidata *nd)
+{
+	current->total_link_count = 0;
+
+	if (nd->flags & LOOKUP_RCU) {
+		unsigned int flags = nd->flags & ~LOOKUP_RCU;
+		const char *rest = name;
+		int err;
+
+		err = path_walk_rcu(&rest, nd);
+		if (err == 0)
+			return 0;
+		if (err == 1) {
+			/*
+			 * path_walk_rcu() sets LOOKUP_CONTINUE for the
+			 * components it got through; the ref-walk has to
+			 * start from the caller's flags so that it can tell
+			 * the last component from the intermediate ones.
+			 */
+			nd->flags = flags & ~LOOKUP_CONTINUE;
+			return link_path_walk(rest, nd);
+		}
+
+		/* the dcache changed under us: redo it the slow way */
+		mntput(nd->path.mnt);
+		err = path_init(AT_FDCWD, name, flags, nd);
+		if (err)
+			return err;
+	}
+	return link_path_walk(name, nd);
+}
+
 /* Returns 0 and nd will be valid on success; Retuns error, otherwise. */
 static int do_path_lookup(int dfd, const char *name,
 				unsigned int flags, struct nameidata *nd)
 {
-	int retval = path_init(dfd, name, flags, nd);
+	int retval = path_init(dfd, name, flags | LOOKUP_RCU, nd);
 	if (!retval)
 		retval = path_walk(name, nd);
 	if (unlikely(!retval && !audit_dummy_context() && nd->path.dentry &&
@@ -1715,7 +1967,7 @@ struct file *do_filp_open(int dfd, const char *pathname,
 	/*
 	 * Create - we need to know the parent.
 	 */
-	error = path_init(dfd, pathname, LOOKUP_PARENT, &nd);
+	error = path_init(dfd, pathname, LOOKUP_PARENT | LOOKUP_RCU, &nd);
 	if (error)
 		return ERR_PTR(error);
 	error = path_walk(pathname, &nd);
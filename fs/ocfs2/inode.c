@@ -1175,7 +1175,7 @@ bail:
 	mlog_exit_void();
 }
 
-/* Called under inode_lock, with no more references on the
+/* Called under inode->i_lock, with no more references on the
  * struct inode, so it's safe here to check the flags field
  * and to manipulate i_nlink without any other locks. */
 void ocfs2_drop_inode(struct inode *inode)
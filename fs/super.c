@@ -57,16 +57,44 @@ static struct super_block *alloc_super(struct file_system_type *type)
 	static const struct super_operations default_op;
 
 	if (s) {
+		int nid;
+
+		s->s_dentry_lru = kcalloc(nr_node_ids, sizeof(struct dentry_lru),
+					  GFP_USER);
+		if (!s->s_dentry_lru) {
+			kfree(s);
+			s = NULL;
+			goto out;
+		}
 		if (security_sb_alloc(s)) {
+			kfree(s->s_dentry_lru);
+			kfree(s);
+			s = NULL;
+			goto out;
+		}
+#ifdef CONFIG_SMP
+		s->s_files = alloc_percpu(struct list_head);
+		if (!s->s_files) {
+			security_sb_free(s);
+			kfree(s->s_dentry_lru);
 			kfree(s);
 			s = NULL;
 			goto out;
+		} else {
+			int i;
+
+			for_each_possible_cpu(i)
+				INIT_LIST_HEAD(per_cpu_ptr(s->s_files, i));
 		}
+#else
 		INIT_LIST_HEAD(&s->s_files);
+#endif
 		INIT_LIST_HEAD(&s->s_instances);
 		INIT_HLIST_HEAD(&s->s_anon);
+		spin_lock_init(&s->s_inodes_lock);
 		INIT_LIST_HEAD(&s->s_inodes);
-		INIT_LIST_HEAD(&s->s_dentry_lru);
+		for (nid = 0; nid < nr_node_ids; nid++)
+			INIT_LIST_HEAD(&s->s_dentry_lru[nid].list);
 		init_rwsem(&s->s_umount);
 		mutex_init(&s->s_lock);
 		lockdep_set_class(&s->s_umount, &type->s_umount_key);
@@ -117,9 +145,13 @@ out:
  */
 static inline void destroy_super(struct super_block *s)
 {
+#ifdef CONFIG_SMP
+	free_percpu(s->s_files);
+#endif
 	security_sb_free(s);
 	kfree(s->s_subtype);
 	kfree(s->s_options);
+	kfree(s->s_dentry_lru);
 	kfree(s);
 }
 
@@ -622,9 +622,21 @@ __SYSCALL(__NR_move_pages, sys_move_pages)
 __SYSCALL(__NR_rt_tgsigqueueinfo, sys_rt_tgsigqueueinfo)
 #define __NR_perf_event_open 241
 __SYSCALL(__NR_perf_event_open, sys_perf_event_open)
+#define __NR_process_vm_readv 242
+__SYSCALL(__NR_process_vm_readv, sys_process_vm_readv)
+#define __NR_process_vm_writev 243
+__SYSCALL(__NR_process_vm_writev, sys_process_vm_writev)
+#define __NR_sched_setattr 244
+__SYSCALL(__NR_sched_setattr, sys_sched_setattr)
+#define __NR_sched_getattr 245
+__SYSCALL(__NR_sched_getattr, sys_sched_getattr)
+#define __NR_io_setup_sq 246
+__SYSCALL(__NR_io_setup_sq, sys_io_setup_sq)
+#define __NR_io_sq_enter 247
+__SYSCALL(__NR_io_sq_enter, sys_io_sq_enter)
 
 #undef __NR_syscalls
-#define __NR_syscalls 242
+#define __NR_syscalls 248
 
 /*
  * All syscalls below here should go away really,
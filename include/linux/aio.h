@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/mutex.h>
 
 #include <asm/atomic.h>
 
@@ -34,6 +35,7 @@ struct kioctx;
 /* #define KIF_LOCKED		0 */
 #define KIF_KICKED		1
 #define KIF_CANCELLED		2
+#define KIF_FIXED_FILE		3	/* ki_filp is owned by the kioctx */
 
 #define kiocbTryLock(iocb)	test_and_set_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbTryKick(iocb)	test_and_set_bit(KIF_KICKED, &(iocb)->ki_flags)
@@ -41,6 +43,7 @@ struct kioctx;
 #define kiocbSetLocked(iocb)	set_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbSetKicked(iocb)	set_bit(KIF_KICKED, &(iocb)->ki_flags)
 #define kiocbSetCancelled(iocb)	set_bit(KIF_CANCELLED, &(iocb)->ki_flags)
+#define kiocbSetFixedFile(iocb)	set_bit(KIF_FIXED_FILE, &(iocb)->ki_flags)
 
 #define kiocbClearLocked(iocb)	clear_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbClearKicked(iocb)	clear_bit(KIF_KICKED, &(iocb)->ki_flags)
@@ -49,6 +52,7 @@ struct kioctx;
 #define kiocbIsLocked(iocb)	test_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbIsKicked(iocb)	test_bit(KIF_KICKED, &(iocb)->ki_flags)
 #define kiocbIsCancelled(iocb)	test_bit(KIF_CANCELLED, &(iocb)->ki_flags)
+#define kiocbIsFixedFile(iocb)	test_bit(KIF_FIXED_FILE, &(iocb)->ki_flags)
 
 /* is there a better place to document function pointer methods? */
 /**
@@ -77,12 +81,13 @@ struct kioctx;
  *
  * If ki_retry returns -EIOCBRETRY it has made a promise that kick_iocb()
  * will be called on the kiocb pointer in the future.  This may happen
- * through generic helpers that associate kiocb->ki_wait with a wait
- * queue head that ki_retry uses via current->io_wait.  It can also happen
- * with custom tracking and manual calls to kick_iocb(), though that is
- * discouraged.  In either case, kick_iocb() must be called once and only
- * once.  ki_retry must ensure forward progress, the AIO core will wait
- * indefinitely for kick_iocb() to be called.
+ * through generic helpers that queue kiocb->ki_wait on a wait queue head,
+ * such as the page lock wait used by buffered reads, or the wait queue
+ * of the file for IOCB_CMD_POLL.  It can also happen with custom tracking
+ * and manual calls to kick_iocb(), though that is discouraged.  In either
+ * case, kick_iocb() must be called once and only once.  ki_retry must
+ * ensure forward progress, the AIO core will wait indefinitely for
+ * kick_iocb() to be called.
  */
 struct kiocb {
 	struct list_head	ki_run_list;
@@ -105,6 +110,16 @@ struct kiocb {
 	wait_queue_t		ki_wait;
 	loff_t			ki_pos;
 
+	union {
+		/* page bit a buffered read waits on */
+		struct wait_bit_key	ki_wait_key;
+		/* IOCB_CMD_POLL */
+		struct {
+			wait_queue_head_t	*head;
+			unsigned		events;
+		} ki_poll;
+	};
+
 	void			*private;
 	/* State that we remember to be able to restart/retry  */
 	unsigned short		ki_opcode;
@@ -177,6 +192,25 @@ struct aio_ring_info {
 	struct page		*internal_pages[AIO_RING_PAGES];
 };
 
+/*
+ * Optional submission ring (io_setup_sq).  The ring itself is only
+ * accessed through its user address, in the context of the owning mm.
+ */
+struct aio_sq_info {
+	unsigned long		mmap_base;
+	unsigned long		mmap_size;
+
+	struct mutex		lock;		/* serialises consumers */
+	unsigned		nr;		/* trusted copy of ring->nr */
+	unsigned		head;		/* trusted copy of ring->head */
+
+	struct file		**files;	/* fixed files */
+	unsigned		nr_files;
+
+	struct task_struct	*thread;	/* AIO_SQ_POLL thread */
+	unsigned long		idle;		/* in jiffies */
+};
+
 struct kioctx {
 	atomic_t		users;
 	int			dead;
@@ -198,6 +232,7 @@ struct kioctx {
 	unsigned		max_reqs;
 
 	struct aio_ring_info	ring_info;
+	struct aio_sq_info	sq_info;
 
 	struct delayed_work	wq;
 
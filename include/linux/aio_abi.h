@@ -37,10 +37,10 @@ enum {
 	IOCB_CMD_PWRITE = 1,
 	IOCB_CMD_FSYNC = 2,
 	IOCB_CMD_FDSYNC = 3,
-	/* These two are experimental.
+	/* This one is experimental.
 	 * IOCB_CMD_PREADX = 4,
-	 * IOCB_CMD_POLL = 5,
 	 */
+	IOCB_CMD_POLL = 5,
 	IOCB_CMD_NOOP = 6,
 	IOCB_CMD_PREADV = 7,
 	IOCB_CMD_PWRITEV = 8,
@@ -51,8 +51,12 @@ enum {
  *
  * IOCB_FLAG_RESFD - Set if the "aio_resfd" member of the "struct iocb"
  *                   is valid.
+ * IOCB_FLAG_FIXED_FILE - Set if "aio_fildes" is an index into the files
+ *                   registered with io_setup_sq() rather than a file
+ *                   descriptor.
  */
 #define IOCB_FLAG_RESFD		(1 << 0)
+#define IOCB_FLAG_FIXED_FILE	(1 << 1)
 
 /* read() from /dev/aio returns these structures. */
 struct io_event {
@@ -104,6 +108,51 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Submission ring, set up with io_setup_sq() and mapped into the
+ * process.  The application fills iocbs[tail & (nr - 1)] and then
+ * advances tail; the kernel consumes entries from head, either from
+ * io_sq_enter() or from a polling thread (AIO_SQ_POLL), and advances
+ * head once it is done with them.  head and tail are free running.
+ *
+ * Entries that cannot be submitted complete immediately, with the
+ * error in the res field of their completion event.
+ */
+#define AIO_SQ_RING_MAGIC	0xa10a5e01
+
+/* aio_sq_ring flags, written by the kernel */
+#define AIO_SQ_NEED_WAKEUP	(1 << 0)	/* poll thread is asleep */
+
+struct aio_sq_ring {
+	__u32	head;
+	__u32	tail;
+	__u32	nr;		/* number of entries, a power of two */
+	__u32	flags;
+
+	__u32	magic;
+	__u32	header_length;	/* size of aio_sq_ring */
+	__u32	reserved[2];
+
+	struct iocb	iocbs[0];
+}; /* 32 bytes + ring size */
+
+/* aio_sq_params flags */
+#define AIO_SQ_POLL		(1 << 0)	/* submit from a kernel thread,
+						 * needs CAP_SYS_ADMIN */
+
+struct aio_sq_params {
+	__u32	nr_entries;	/* in: ring size, rounded up to a power of 2 */
+	__u32	flags;		/* in: AIO_SQ_* */
+	__u32	nr_files;	/* in: number of fixed files */
+	__u32	idle_ms;	/* in: AIO_SQ_POLL thread idle time, 0: 1s,
+				 * at most 1s */
+	__u64	files;		/* in: array of nr_files __s32 descriptors */
+	__u64	ring;		/* out: address of the struct aio_sq_ring */
+};
+
+/* io_sq_enter() flags */
+#define AIO_SQ_ENTER_WAKEUP	(1 << 0)	/* wake up the poll thread */
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -7,6 +7,7 @@
 #include <linux/spinlock.h>
 #include <linux/cache.h>
 #include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 
 struct nameidata;
 struct path;
@@ -45,6 +46,12 @@ struct dentry_stat_t {
 };
 extern struct dentry_stat_t dentry_stat;
 
+/* Unused dentries of one superblock on one node, protected by dcache_lock */
+struct dentry_lru {
+	struct list_head list;
+	int nr_unused;
+};
+
 /* Name hashing routines. Initial hash value */
 /* Hash courtesy of the R5 hash in reiserfs modulo sign bits */
 #define init_name_hash()		0
@@ -81,15 +88,16 @@ full_name_hash(const unsigned char *name, unsigned int len)
  * large memory footprint increase).
  */
 #ifdef CONFIG_64BIT
-#define DNAME_INLINE_LEN_MIN 32 /* 192 bytes */
+#define DNAME_INLINE_LEN_MIN 24 /* 192 bytes */
 #else
-#define DNAME_INLINE_LEN_MIN 40 /* 128 bytes */
+#define DNAME_INLINE_LEN_MIN 36 /* 128 bytes */
 #endif
 
 struct dentry {
 	atomic_t d_count;
 	unsigned int d_flags;		/* protected by d_lock */
 	spinlock_t d_lock;		/* per dentry lock */
+	seqcount_t d_seq;		/* per dentry seqlock, for RCU walk */
 	int d_mounted;
 	struct inode *d_inode;		/* Where the name belongs to - NULL is
 					 * negative */
@@ -189,6 +197,17 @@ d_iput:		no		no		no       yes
 extern spinlock_t dcache_lock;
 extern seqlock_t rename_lock;
 
+/*
+ * Invalidate any RCU path walk that sampled dentry->d_seq before a
+ * change to the dentry's hashing, name or inode.
+ * Requires dentry->d_lock.
+ */
+static inline void dentry_rcuwalk_barrier(struct dentry *dentry)
+{
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_end(&dentry->d_seq);
+}
+
 /**
  * d_drop - drop a dentry
  * @dentry: dentry to drop
@@ -210,6 +229,7 @@ static inline void __d_drop(struct dentry *dentry)
 	if (!(dentry->d_flags & DCACHE_UNHASHED)) {
 		dentry->d_flags |= DCACHE_UNHASHED;
 		hlist_del_rcu(&dentry->d_hash);
+		dentry_rcuwalk_barrier(dentry);
 	}
 }
 
@@ -301,6 +321,7 @@ extern struct dentry *d_ancestor(struct dentry *, struct dentry *);
 /* appendix may either be NULL or be used for transname suffixes */
 extern struct dentry * d_lookup(struct dentry *, struct qstr *);
 extern struct dentry * __d_lookup(struct dentry *, struct qstr *);
+extern struct dentry *__d_lookup_rcu(struct dentry *, struct qstr *, unsigned *);
 extern struct dentry * d_hash_and_lookup(struct dentry *, struct qstr *);
 
 /* validate "insecure" dentry pointer */
@@ -358,6 +379,24 @@ static inline int d_unlinked(struct dentry *dentry)
 	return d_unhashed(dentry) && !IS_ROOT(dentry);
 }
 
+/**
+ * __d_rcu_to_refcount - take a reference on a dentry found by RCU walk
+ * @dentry: dentry returned by __d_lookup_rcu()
+ * @seq: d_seq value sampled when the dentry was found
+ *
+ * Returns 1 and takes a reference if the dentry has not changed since
+ * @seq was sampled, 0 otherwise. Requires dentry->d_lock.
+ */
+static inline int __d_rcu_to_refcount(struct dentry *dentry, unsigned seq)
+{
+	if (read_seqcount_retry(&dentry->d_seq, seq))
+		return 0;
+	if (!atomic_read(&dentry->d_count) && d_unhashed(dentry))
+		return 0;
+	atomic_inc(&dentry->d_count);
+	return 1;
+}
+
 static inline struct dentry *dget_parent(struct dentry *dentry)
 {
 	struct dentry *ret;
@@ -51,6 +51,16 @@ static inline struct eventfd_ctx *eventfd_ctx_fdget(int fd)
 	return ERR_PTR(-ENOSYS);
 }
 
+static inline struct file *eventfd_fget(int fd)
+{
+	return ERR_PTR(-ENOSYS);
+}
+
+static inline struct eventfd_ctx *eventfd_ctx_fileget(struct file *file)
+{
+	return ERR_PTR(-ENOSYS);
+}
+
 static inline int eventfd_signal(struct eventfd_ctx *ctx, int n)
 {
 	return -ENOSYS;
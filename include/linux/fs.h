@@ -179,6 +179,9 @@ struct inodes_stat_t {
 #define FS_RENAME_DOES_D_MOVE	32768	/* FS will handle d_move()
 					 * during rename() internally.
 					 */
+#define FS_RCU_INODES	65536	/* ->destroy_inode() frees the inode
+					 * after an RCU grace period.
+					 */
 
 /*
  * These are the fs-independent mount-flags: up to 32 flags are supported
@@ -386,6 +389,7 @@ struct inodes_stat_t {
 
 struct export_operations;
 struct hd_geometry;
+struct inode_hash_bucket;
 struct iovec;
 struct nameidata;
 struct kiocb;
@@ -722,9 +726,14 @@ struct posix_acl;
 
 struct inode {
 	struct hlist_node	i_hash;
+	struct inode_hash_bucket *i_hash_bucket;
 	struct list_head	i_list;		/* backing dev IO list */
+	struct list_head	i_lru;		/* unused inode list */
 	struct list_head	i_sb_list;
-	struct list_head	i_dentry;
+	union {
+		struct list_head	i_dentry;
+		struct rcu_head		i_rcu;	/* freeing, see destroy_inode() */
+	};
 	unsigned long		i_ino;
 	atomic_t		i_count;
 	unsigned int		i_nlink;
@@ -918,6 +927,9 @@ struct file {
 		struct list_head	fu_list;
 		struct rcu_head 	fu_rcuhead;
 	} f_u;
+#ifdef CONFIG_SMP
+	int			f_sb_list_cpu;
+#endif
 	struct path		f_path;
 #define f_dentry	f_path.dentry
 #define f_vfsmnt	f_path.mnt
@@ -948,10 +960,6 @@ struct file {
 	unsigned long f_mnt_write_state;
 #endif
 };
-extern spinlock_t files_lock;
-#define file_list_lock() spin_lock(&files_lock);
-#define file_list_unlock() spin_unlock(&files_lock);
-
 #define get_file(x)	atomic_long_inc(&(x)->f_count)
 #define file_count(x)	atomic_long_read(&(x)->f_count)
 
@@ -1345,12 +1353,15 @@ struct super_block {
 #endif
 	struct xattr_handler	**s_xattr;
 
+	spinlock_t		s_inodes_lock;
 	struct list_head	s_inodes;	/* all inodes */
 	struct hlist_head	s_anon;		/* anonymous dentries for (nfs) exporting */
+#ifdef CONFIG_SMP
+	struct list_head	*s_files;	/* per-cpu open files */
+#else
 	struct list_head	s_files;
-	/* s_dentry_lru and s_nr_dentry_unused are protected by dcache_lock */
-	struct list_head	s_dentry_lru;	/* unused dentry lru */
-	int			s_nr_dentry_unused;	/* # of dentry on lru */
+#endif
+	struct dentry_lru	*s_dentry_lru;	/* unused dentry lru per node */
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
@@ -1550,7 +1561,8 @@ struct seq_file;
 ssize_t rw_copy_check_uvector(int type, const struct iovec __user * uvector,
 				unsigned long nr_segs, unsigned long fast_segs,
 				struct iovec *fast_pointer,
-				struct iovec **ret_pointer);
+				struct iovec **ret_pointer,
+				int check_access);
 
 extern ssize_t vfs_read(struct file *, char __user *, size_t, loff_t *);
 extern ssize_t vfs_write(struct file *, const char __user *, size_t, loff_t *);
@@ -1587,7 +1599,7 @@ struct super_operations {
 };
 
 /*
- * Inode state bits.  Protected by inode_lock.
+ * Inode state bits.  Protected by inode->i_lock.
  *
  * Three bits determine the dirty state of the inode, I_DIRTY_SYNC,
  * I_DIRTY_DATASYNC and I_DIRTY_PAGES.
@@ -2199,8 +2211,8 @@ static inline void insert_inode_hash(struct inode *inode) {
 }
 
 extern struct file * get_empty_filp(void);
-extern void file_move(struct file *f, struct list_head *list);
-extern void file_kill(struct file *f);
+extern void file_sb_list_add(struct file *f, struct super_block *sb);
+extern void file_sb_list_del(struct file *f);
 #ifdef CONFIG_BLOCK
 struct bio;
 extern void submit_bio(int, struct bio *);
@@ -2486,6 +2498,8 @@ ssize_t simple_attr_write(struct file *file, const char __user *buf,
 struct ctl_table;
 int proc_nr_files(struct ctl_table *table, int write,
 		  void __user *buffer, size_t *lenp, loff_t *ppos);
+int proc_nr_inodes(struct ctl_table *table, int write,
+		   void __user *buffer, size_t *lenp, loff_t *ppos);
 
 int __init get_filesystem_list(char *buf);
 
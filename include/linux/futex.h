@@ -20,6 +20,7 @@
 #define FUTEX_WAKE_BITSET	10
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
+#define FUTEX_WAIT_MULTIPLE	13
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -39,6 +40,25 @@
 					 FUTEX_PRIVATE_FLAG)
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
+#define FUTEX_WAIT_MULTIPLE_PRIVATE	(FUTEX_WAIT_MULTIPLE | \
+					 FUTEX_PRIVATE_FLAG)
+
+/*
+ * Array element for FUTEX_WAIT_MULTIPLE: wait on the futex at @uaddr
+ * as long as it contains @val.  The futex is private if @flags contains
+ * FUTEX_PRIVATE_FLAG; the flag in the futex op itself is ignored.
+ *
+ * FUTEX_WAIT_MULTIPLE takes an array of up to FUTEX_WAITV_MAX of these
+ * in uaddr, their number in val and an optional relative timeout in
+ * utime.  It returns the index of the futex which was woken.
+ */
+struct futex_waitv {
+	__u64 uaddr;
+	__u32 val;
+	__u32 flags;
+};
+
+#define FUTEX_WAITV_MAX		128
 
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
@@ -0,0 +1,72 @@
+#ifndef _LINUX_LATENCY_HIST_H
+#define _LINUX_LATENCY_HIST_H
+
+/*
+ * Scheduler latency histograms
+ *
+ * Per-cpu, log2-bucketed distributions of wakeup latency, runqueue
+ * wait time and preempt-off/irqs-off section lengths. Bucket 0 counts
+ * zero-length samples, bucket n (n > 0) counts samples of
+ * [2^(n-1), 2^n) nanoseconds, and the last bucket is open ended.
+ *
+ * Updates only ever touch the local cpu's counters, from contexts that
+ * cannot migrate, so no locking or atomics are needed. Readers sum the
+ * per-cpu counters without synchronisation.
+ */
+
+#include <linux/types.h>
+#include <linux/bitops.h>
+
+#define LATENCY_HIST_BUCKETS	40
+
+enum latency_hist_type {
+	LATENCY_HIST_WAKEUP,		/* wakeup until first run */
+	LATENCY_HIST_RQWAIT,		/* runnable but waiting for the cpu */
+	LATENCY_HIST_PREEMPTOFF,	/* preemption disabled */
+	LATENCY_HIST_IRQSOFF,		/* hard interrupts disabled */
+	NR_LATENCY_HISTS,
+};
+
+struct latency_hist {
+	unsigned long		count[LATENCY_HIST_BUCKETS];
+};
+
+static inline void latency_hist_add(struct latency_hist *hist, u64 delta)
+{
+	int bucket = fls64(delta);
+
+	if (bucket >= LATENCY_HIST_BUCKETS)
+		bucket = LATENCY_HIST_BUCKETS - 1;
+	hist->count[bucket]++;
+}
+
+static inline void latency_hist_merge(struct latency_hist *sum,
+				      const struct latency_hist *hist)
+{
+	int i;
+
+	for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+		sum->count[i] += hist->count[i];
+}
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+struct seq_file;
+
+extern u32 latency_hist_enabled;
+
+extern void latency_hist_record(enum latency_hist_type type, u64 delta);
+extern void latency_hist_print(struct seq_file *m,
+			       const struct latency_hist *hist);
+
+extern void latency_hist_preempt_off(void);
+extern void latency_hist_preempt_on(void);
+extern void latency_hist_irqs_off(void);
+extern void latency_hist_irqs_on(void);
+#else
+static inline void latency_hist_preempt_off(void) { }
+static inline void latency_hist_preempt_on(void) { }
+static inline void latency_hist_irqs_off(void) { }
+static inline void latency_hist_irqs_on(void) { }
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
+#endif /* _LINUX_LATENCY_HIST_H */
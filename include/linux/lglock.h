@@ -0,0 +1,160 @@
+#ifndef __LINUX_LGLOCK_H
+#define __LINUX_LGLOCK_H
+/*
+ * Local/global spinlocks.
+ *
+ * An lglock is an array of per-cpu spinlocks.  The local lock takes the
+ * lock of the current (or a given) CPU only, and is therefore cheap and
+ * does not bounce cachelines between CPUs as long as everybody sticks to
+ * their own CPU.  The global lock takes the locks of all possible CPUs,
+ * and is correspondingly expensive.
+ *
+ * This gives fast exclusive access to per-CPU data, with slow exclusive
+ * access to all of it, e.g. for per-CPU lists that are added to and
+ * removed from all the time but rarely walked as a whole.
+ *
+ * lglocks can only be declared as global variables: they are meant for
+ * a handful of hot, system wide locks, not for dynamically allocated
+ * structures.
+ */
+
+#include <linux/spinlock.h>
+#include <linux/lockdep.h>
+#include <linux/percpu.h>
+
+#define lg_lock_init(name)		name##_lock_init()
+#define lg_local_lock(name)		name##_local_lock()
+#define lg_local_unlock(name)		name##_local_unlock()
+#define lg_local_lock_cpu(name, cpu)	name##_local_lock_cpu(cpu)
+#define lg_local_unlock_cpu(name, cpu)	name##_local_unlock_cpu(cpu)
+#define lg_global_lock(name)		name##_global_lock()
+#define lg_global_unlock(name)		name##_global_unlock()
+
+/*
+ * A "big reader" lock is an lglock used as a reader/writer lock: readers
+ * take the lock of their own CPU only, writers take all of them.  Readers
+ * on different CPUs never touch each other's cachelines.  Read sections
+ * must not nest on the same CPU.
+ */
+#define br_lock_init(name)		name##_lock_init()
+#define br_read_lock(name)		name##_local_lock()
+#define br_read_unlock(name)		name##_local_unlock()
+#define br_write_lock(name)		name##_global_lock()
+#define br_write_unlock(name)		name##_global_unlock()
+
+#define DECLARE_BRLOCK(name)		DECLARE_LGLOCK(name)
+#define DEFINE_BRLOCK(name)		DEFINE_LGLOCK(name)
+
+#ifdef CONFIG_DEBUG_LOCK_ALLOC
+#define LOCKDEP_INIT_MAP lockdep_init_map
+
+#define DEFINE_LGLOCK_LOCKDEP(name)					\
+ struct lock_class_key name##_lock_key;					\
+ struct lockdep_map name##_lock_dep_map;				\
+ EXPORT_SYMBOL(name##_lock_dep_map)
+
+#else
+#define LOCKDEP_INIT_MAP(a, b, c, d)
+
+#define DEFINE_LGLOCK_LOCKDEP(name)
+#endif
+
+#define DECLARE_LGLOCK(name)						\
+ extern void name##_lock_init(void);					\
+ extern void name##_local_lock(void);					\
+ extern void name##_local_unlock(void);					\
+ extern void name##_local_lock_cpu(int cpu);				\
+ extern void name##_local_unlock_cpu(int cpu);				\
+ extern void name##_global_lock(void);					\
+ extern void name##_global_unlock(void);
+
+/*
+ * Lockdep sees the local lock as the read side and the global lock as the
+ * write side of a single rwlock: two local locks never conflict, anything
+ * else does.  The per-cpu locks are raw so that lockdep does not see the
+ * global lock as a nesting of NR_CPUS instances of the same class.
+ */
+#define DEFINE_LGLOCK(name)						\
+									\
+ DEFINE_PER_CPU(raw_spinlock_t, name##_lock);				\
+ DEFINE_LGLOCK_LOCKDEP(name);						\
+									\
+ void name##_lock_init(void)						\
+ {									\
+	int i;								\
+	LOCKDEP_INIT_MAP(&name##_lock_dep_map, #name, &name##_lock_key, 0); \
+	for_each_possible_cpu(i) {					\
+		raw_spinlock_t *lock;					\
+		lock = &per_cpu(name##_lock, i);			\
+		*lock = (raw_spinlock_t)__RAW_SPIN_LOCK_UNLOCKED;	\
+	}								\
+ }									\
+ EXPORT_SYMBOL(name##_lock_init);					\
+									\
+ void name##_local_lock(void)						\
+ {									\
+	raw_spinlock_t *lock;						\
+	preempt_disable();						\
+	rwlock_acquire_read(&name##_lock_dep_map, 0, 0, _THIS_IP_);	\
+	lock = &__get_cpu_var(name##_lock);				\
+	__raw_spin_lock(lock);						\
+ }									\
+ EXPORT_SYMBOL(name##_local_lock);					\
+									\
+ void name##_local_unlock(void)						\
+ {									\
+	raw_spinlock_t *lock;						\
+	rwlock_release(&name##_lock_dep_map, 1, _THIS_IP_);		\
+	lock = &__get_cpu_var(name##_lock);				\
+	__raw_spin_unlock(lock);					\
+	preempt_enable();						\
+ }									\
+ EXPORT_SYMBOL(name##_local_unlock);					\
+									\
+ void name##_local_lock_cpu(int cpu)					\
+ {									\
+	raw_spinlock_t *lock;						\
+	preempt_disable();						\
+	rwlock_acquire_read(&name##_lock_dep_map, 0, 0, _THIS_IP_);	\
+	lock = &per_cpu(name##_lock, cpu);				\
+	__raw_spin_lock(lock);						\
+ }									\
+ EXPORT_SYMBOL(name##_local_lock_cpu);					\
+									\
+ void name##_local_unlock_cpu(int cpu)					\
+ {									\
+	raw_spinlock_t *lock;						\
+	rwlock_release(&name##_lock_dep_map, 1, _THIS_IP_);		\
+	lock = &per_cpu(name##_lock, cpu);				\
+	__raw_spin_unlock(lock);					\
+	preempt_enable();						\
+ }									\
+ EXPORT_SYMBOL(name##_local_unlock_cpu);				\
+									\
+ void name##_global_lock(void)						\
+ {									\
+	int i;								\
+	preempt_disable();						\
+	rwlock_acquire(&name##_lock_dep_map, 0, 0, _RET_IP_);		\
+	for_each_possible_cpu(i) {					\
+		raw_spinlock_t *lock;					\
+		lock = &per_cpu(name##_lock, i);			\
+		__raw_spin_lock(lock);					\
+	}								\
+ }									\
+ EXPORT_SYMBOL(name##_global_lock);					\
+									\
+ void name##_global_unlock(void)					\
+ {									\
+	int i;								\
+	rwlock_release(&name##_lock_dep_map, 1, _RET_IP_);		\
+	for_each_possible_cpu(i) {					\
+		raw_spinlock_t *lock;					\
+		lock = &per_cpu(name##_lock, i);			\
+		__raw_spin_unlock(lock);				\
+	}								\
+	preempt_enable();						\
+ }									\
+ EXPORT_SYMBOL(name##_global_unlock);
+
+#endif
@@ -877,14 +877,22 @@ int __get_user_pages_fast(unsigned long start, int nr_pages, int write,
  *
  * Note that 'shrink' will be passed nr_to_scan == 0 when the VM is
  * querying the cache size, so a fastpath for that case is appropriate.
+ *
+ * Caches which keep their objects on per-node LRUs can also provide
+ * 'shrink_node', which has the same semantics but only counts and scans
+ * the objects on node 'nid'.  It is then called for each node the VM is
+ * reclaiming from, so reclaim on one node leaves the caches on other nodes
+ * alone.  'shrink' must still be provided and cover all the nodes.
  */
 struct shrinker {
 	int (*shrink)(int nr_to_scan, gfp_t gfp_mask);
+	int (*shrink_node)(int nr_to_scan, gfp_t gfp_mask, int nid);
 	int seeks;	/* seeks to recreate an obj */
 
 	/* These are for internal use */
 	struct list_head list;
 	long nr;	/* objs pending delete */
+	long *nr_node;	/* objs pending delete, per node */
 };
 #define DEFAULT_SEEKS 2 /* A good number if you don't know better. */
 extern void register_shrinker(struct shrinker *);
@@ -1301,7 +1309,7 @@ int in_gate_area_no_task(unsigned long addr);
 int drop_caches_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 unsigned long shrink_slab(unsigned long scanned, gfp_t gfp_mask,
-			unsigned long lru_pages);
+			unsigned long lru_pages, const nodemask_t *nodes);
 
 #ifndef CONFIG_MMU
 #define randomize_va_space 0
@@ -13,6 +13,7 @@
 #include <linux/list.h>
 #include <linux/nodemask.h>
 #include <linux/spinlock.h>
+#include <linux/lglock.h>
 #include <asm/atomic.h>
 
 struct super_block;
@@ -123,7 +124,7 @@ extern int do_add_mount(struct vfsmount *newmnt, struct path *path,
 
 extern void mark_mounts_for_expiry(struct list_head *mounts);
 
-extern spinlock_t vfsmount_lock;
+DECLARE_BRLOCK(vfsmount_lock);
 extern dev_t name_to_dev_t(char *name);
 
 #endif /* _LINUX_MOUNT_H */
@@ -22,6 +22,7 @@ struct nameidata {
 	unsigned int	flags;
 	int		last_type;
 	unsigned	depth;
+	unsigned	seq;	/* d_seq of path.dentry in LOOKUP_RCU mode */
 	char *saved_names[MAX_NESTED_LINKS + 1];
 
 	/* Intent data */
@@ -43,12 +44,14 @@ enum {LAST_NORM, LAST_ROOT, LAST_DOT, LAST_DOTDOT, LAST_BIND};
  *  - internal "there are more path components" flag
  *  - locked when lookup done with dcache_lock held
  *  - dentry cache is untrusted; force a real lookup
+ *  - try the RCU path walk first; path.dentry is not referenced meanwhile
  */
 #define LOOKUP_FOLLOW		 1
 #define LOOKUP_DIRECTORY	 2
 #define LOOKUP_CONTINUE		 4
 #define LOOKUP_PARENT		16
 #define LOOKUP_REVAL		64
+#define LOOKUP_RCU		128
 /*
  * Intent data
  */
@@ -37,19 +37,18 @@ int stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus);
 int __stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus);
 
 /**
- * stop_machine_create: create all stop_machine threads
+ * stop_machine_create: make sure the stop_machine threads exist
  *
- * Description: This causes all stop_machine threads to be created before
- * stop_machine actually gets called. This can be used by subsystems that
- * need a non failing stop_machine infrastructure.
+ * Description: The per-cpu stop_machine threads are created when a cpu
+ * comes up and live as long as it stays online, so this always succeeds.
+ * Kept for subsystems that need a non failing stop_machine infrastructure.
  */
 int stop_machine_create(void);
 
 /**
- * stop_machine_destroy: destroy all stop_machine threads
+ * stop_machine_destroy: counterpart of stop_machine_create
  *
- * Description: This causes all stop_machine threads which were created with
- * stop_machine_create to be destroyed again.
+ * Description: Does nothing, the stop_machine threads stay around.
  */
 void stop_machine_destroy(void);
 
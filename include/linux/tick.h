@@ -36,6 +36,8 @@ enum tick_nohz_mode {
  *			when the CPU returns from idle
  * @tick_stopped:	Indicator that the idle tick has been stopped
  * @idle_jiffies:	jiffies at the entry to idle for idle time accounting
+ *			(or, on a nohz_full CPU, at the point the busy tick
+ *			was stopped for cputime accounting)
  * @idle_calls:		Total number of idle calls
  * @idle_sleeps:	Number of idle calls, where the sched tick was stopped
  * @idle_entrytime:	Time when the idle call was entered
@@ -134,4 +136,35 @@ static inline ktime_t tick_nohz_get_sleep_length(void)
 static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_FULL
+extern bool tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+static inline bool tick_nohz_full_cpu(int cpu)
+{
+	if (!tick_nohz_full_running)
+		return false;
+	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern void __tick_nohz_full_check(void);
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_full_kick_timer(int cpu);
+
+/*
+ * Re-evaluate whether the current CPU can run without its tick.
+ * Called from irq_exit() and at the end of schedule().
+ */
+static inline void tick_nohz_full_check(void)
+{
+	if (tick_nohz_full_running)
+		__tick_nohz_full_check();
+}
+# else
+static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline void tick_nohz_full_check(void) { }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline void tick_nohz_full_kick_timer(int cpu) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
@@ -9,9 +9,7 @@
 
 struct backing_dev_info;
 
-extern spinlock_t inode_lock;
-extern struct list_head inode_in_use;
-extern struct list_head inode_unused;
+extern spinlock_t inode_wb_list_lock;
 
 /*
  * fs/fs-writeback.c
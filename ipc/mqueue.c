@@ -31,6 +31,7 @@
 #include <linux/mutex.h>
 #include <linux/nsproxy.h>
 #include <linux/pid.h>
+#include <linux/rbtree.h>
 #include <linux/ipc_namespace.h>
 #include <linux/ima.h>
 
@@ -48,6 +49,16 @@
 #define STATE_PENDING	1
 #define STATE_READY	2
 
+/*
+ * Messages are kept in an rbtree ordered by priority, with one node per
+ * priority in use holding the FIFO list of messages of that priority.
+ */
+struct posix_msg_tree_node {
+	struct rb_node		rb_node;
+	struct list_head	msg_list;
+	int			priority;
+};
+
 struct ext_wait_queue {		/* queue of sleeping tasks */
 	struct task_struct *task;
 	struct list_head list;
@@ -60,7 +71,9 @@ struct mqueue_inode_info {
 	struct inode vfs_inode;
 	wait_queue_head_t wait_q;
 
-	struct msg_msg **messages;
+	struct rb_root msg_tree;
+	struct rb_node *msg_tree_rightmost;	/* highest priority */
+	struct posix_msg_tree_node *node_cache;	/* spare node, see msg_insert */
 	struct mq_attr attr;
 
 	struct sigevent notify;
@@ -89,6 +102,21 @@ static inline struct mqueue_inode_info *MQUEUE_I(struct inode *inode)
 	return container_of(inode, struct mqueue_inode_info, vfs_inode);
 }
 
+/*
+ * Memory charged against RLIMIT_MSGQUEUE for a queue: the message
+ * headers and payloads, plus at most one tree node per priority.
+ */
+static unsigned long mq_attr_bytes(struct mq_attr *attr)
+{
+	unsigned long mq_treesize;
+
+	mq_treesize = attr->mq_maxmsg * sizeof(struct msg_msg) +
+		min_t(unsigned long, attr->mq_maxmsg, MQ_PRIO_MAX) *
+		sizeof(struct posix_msg_tree_node);
+
+	return mq_treesize + attr->mq_maxmsg * attr->mq_msgsize;
+}
+
 /*
  * This routine should be called with the mq_lock held.
  */
@@ -107,6 +135,107 @@ static struct ipc_namespace *get_ns_from_inode(struct inode *inode)
 	return ns;
 }
 
+/*
+ * Auxiliary functions to manipulate the message tree, called with
+ * info->lock held.
+ *
+ * Adding a message of a priority not yet in the tree consumes
+ * info->node_cache, which senders refill before taking the lock, so
+ * that normally nothing is allocated under it. If a concurrent sender
+ * used it up in between, fall back to an atomic allocation; msg_insert()
+ * returns -ENOMEM only if that fails too.
+ */
+static int msg_insert(struct msg_msg *msg, struct mqueue_inode_info *info)
+{
+	struct rb_node **p, *parent = NULL;
+	struct posix_msg_tree_node *leaf;
+	int rightmost = 1;
+
+	p = &info->msg_tree.rb_node;
+	while (*p) {
+		parent = *p;
+		leaf = rb_entry(parent, struct posix_msg_tree_node, rb_node);
+		if (likely(leaf->priority == msg->m_type))
+			goto insert_msg;
+		else if (msg->m_type < leaf->priority) {
+			p = &(*p)->rb_left;
+			rightmost = 0;
+		} else
+			p = &(*p)->rb_right;
+	}
+	if (info->node_cache) {
+		leaf = info->node_cache;
+		info->node_cache = NULL;
+	} else {
+		leaf = kmalloc(sizeof(*leaf), GFP_ATOMIC);
+		if (!leaf)
+			return -ENOMEM;
+		INIT_LIST_HEAD(&leaf->msg_list);
+	}
+	leaf->priority = msg->m_type;
+	if (rightmost)
+		info->msg_tree_rightmost = &leaf->rb_node;
+	rb_link_node(&leaf->rb_node, parent, p);
+	rb_insert_color(&leaf->rb_node, &info->msg_tree);
+insert_msg:
+	info->attr.mq_curmsgs++;
+	info->qsize += msg->m_ts;
+	list_add_tail(&msg->m_list, &leaf->msg_list);
+	return 0;
+}
+
+/*
+ * Remove the oldest message of the highest priority. The queue must not
+ * be empty. A node that becomes empty is kept as info->node_cache if
+ * there is none yet.
+ */
+static struct msg_msg *msg_get(struct mqueue_inode_info *info)
+{
+	struct rb_node *node = info->msg_tree_rightmost;
+	struct posix_msg_tree_node *leaf;
+	struct msg_msg *msg;
+
+	leaf = rb_entry(node, struct posix_msg_tree_node, rb_node);
+	msg = list_first_entry(&leaf->msg_list, struct msg_msg, m_list);
+	list_del(&msg->m_list);
+	if (list_empty(&leaf->msg_list)) {
+		info->msg_tree_rightmost = rb_prev(node);
+		rb_erase(node, &info->msg_tree);
+		if (info->node_cache)
+			kfree(leaf);
+		else
+			info->node_cache = leaf;
+	}
+	info->attr.mq_curmsgs--;
+	info->qsize -= msg->m_ts;
+	return msg;
+}
+
+static struct posix_msg_tree_node *msg_tree_node_alloc(void)
+{
+	struct posix_msg_tree_node *leaf;
+
+	leaf = kmalloc(sizeof(*leaf), GFP_KERNEL);
+	if (leaf)
+		INIT_LIST_HEAD(&leaf->msg_list);
+	return leaf;
+}
+
+/*
+ * Install a node allocated by msg_tree_node_alloc() as the spare node if
+ * there is none. Returns the node if it was not needed.
+ */
+static struct posix_msg_tree_node *
+msg_tree_node_cache(struct mqueue_inode_info *info,
+		    struct posix_msg_tree_node *leaf)
+{
+	if (leaf && !info->node_cache) {
+		info->node_cache = leaf;
+		leaf = NULL;
+	}
+	return leaf;
+}
+
 static struct inode *mqueue_get_inode(struct super_block *sb,
 		struct ipc_namespace *ipc_ns, int mode,
 		struct mq_attr *attr)
@@ -125,7 +254,7 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 		if (S_ISREG(mode)) {
 			struct mqueue_inode_info *info;
 			struct task_struct *p = current;
-			unsigned long mq_bytes, mq_msg_tblsz;
+			unsigned long mq_bytes;
 
 			inode->i_fop = &mqueue_file_operations;
 			inode->i_size = FILENT_SIZE;
@@ -135,7 +264,9 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 			init_waitqueue_head(&info->wait_q);
 			INIT_LIST_HEAD(&info->e_wait_q[0].list);
 			INIT_LIST_HEAD(&info->e_wait_q[1].list);
-			info->messages = NULL;
+			info->msg_tree = RB_ROOT;
+			info->msg_tree_rightmost = NULL;
+			info->node_cache = NULL;
 			info->notify_owner = NULL;
 			info->qsize = 0;
 			info->user = NULL;	/* set when all is ok */
@@ -146,9 +277,7 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 				info->attr.mq_maxmsg = attr->mq_maxmsg;
 				info->attr.mq_msgsize = attr->mq_msgsize;
 			}
-			mq_msg_tblsz = info->attr.mq_maxmsg * sizeof(struct msg_msg *);
-			mq_bytes = (mq_msg_tblsz +
-				(info->attr.mq_maxmsg * info->attr.mq_msgsize));
+			mq_bytes = mq_attr_bytes(&info->attr);
 
 			spin_lock(&mq_lock);
 			if (u->mq_bytes + mq_bytes < u->mq_bytes ||
@@ -160,13 +289,6 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 			u->mq_bytes += mq_bytes;
 			spin_unlock(&mq_lock);
 
-			info->messages = kmalloc(mq_msg_tblsz, GFP_KERNEL);
-			if (!info->messages) {
-				spin_lock(&mq_lock);
-				u->mq_bytes -= mq_bytes;
-				spin_unlock(&mq_lock);
-				goto out_inode;
-			}
 			/* all is ok */
 			info->user = get_uid(u);
 		} else if (S_ISDIR(mode)) {
@@ -248,7 +370,6 @@ static void mqueue_delete_inode(struct inode *inode)
 	struct mqueue_inode_info *info;
 	struct user_struct *user;
 	unsigned long mq_bytes;
-	int i;
 	struct ipc_namespace *ipc_ns;
 
 	if (S_ISDIR(inode->i_mode)) {
@@ -258,15 +379,14 @@ static void mqueue_delete_inode(struct inode *inode)
 	ipc_ns = get_ns_from_inode(inode);
 	info = MQUEUE_I(inode);
 	spin_lock(&info->lock);
-	for (i = 0; i < info->attr.mq_curmsgs; i++)
-		free_msg(info->messages[i]);
-	kfree(info->messages);
+	while (info->attr.mq_curmsgs)
+		free_msg(msg_get(info));
+	kfree(info->node_cache);
 	spin_unlock(&info->lock);
 
 	clear_inode(inode);
 
-	mq_bytes = (info->attr.mq_maxmsg * sizeof(struct msg_msg *) +
-		   (info->attr.mq_maxmsg * info->attr.mq_msgsize));
+	mq_bytes = mq_attr_bytes(&info->attr);
 	user = info->user;
 	if (user) {
 		spin_lock(&mq_lock);
@@ -484,27 +604,6 @@ static struct ext_wait_queue *wq_get_first_waiter(
 	return list_entry(ptr, struct ext_wait_queue, list);
 }
 
-/* Auxiliary functions to manipulate messages' list */
-static void msg_insert(struct msg_msg *ptr, struct mqueue_inode_info *info)
-{
-	int k;
-
-	k = info->attr.mq_curmsgs - 1;
-	while (k >= 0 && info->messages[k]->m_type >= ptr->m_type) {
-		info->messages[k + 1] = info->messages[k];
-		k--;
-	}
-	info->attr.mq_curmsgs++;
-	info->qsize += ptr->m_ts;
-	info->messages[k + 1] = ptr;
-}
-
-static inline struct msg_msg *msg_get(struct mqueue_inode_info *info)
-{
-	info->qsize -= info->messages[--info->attr.mq_curmsgs]->m_ts;
-	return info->messages[info->attr.mq_curmsgs];
-}
-
 static inline void set_cookie(struct sk_buff *skb, char code)
 {
 	((char*)skb->data)[NOTIFY_COOKIE_LEN-1] = code;
@@ -605,8 +704,7 @@ static int mq_attr_ok(struct ipc_namespace *ipc_ns, struct mq_attr *attr)
 	/* check for overflow */
 	if (attr->mq_msgsize > ULONG_MAX/attr->mq_maxmsg)
 		return 0;
-	if ((unsigned long)(attr->mq_maxmsg * attr->mq_msgsize) +
-	    (attr->mq_maxmsg * sizeof (struct msg_msg *)) <
+	if (mq_attr_bytes(attr) <
 	    (unsigned long)(attr->mq_maxmsg * attr->mq_msgsize))
 		return 0;
 	return 1;
@@ -838,7 +936,9 @@ static inline void pipelined_receive(struct mqueue_inode_info *info)
 		wake_up_interruptible(&info->wait_q);
 		return;
 	}
-	msg_insert(sender->msg, info);
+	/* out of memory: the sender keeps waiting for the next receive */
+	if (msg_insert(sender->msg, info))
+		return;
 	list_del(&sender->list);
 	sender->state = STATE_PENDING;
 	wake_up_process(sender->task);
@@ -856,6 +956,7 @@ SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 	struct ext_wait_queue *receiver;
 	struct msg_msg *msg_ptr;
 	struct mqueue_inode_info *info;
+	struct posix_msg_tree_node *new_leaf = NULL;
 	struct timespec ts, *p = NULL;
 	long timeout;
 	int ret;
@@ -902,7 +1003,12 @@ SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 	msg_ptr->m_ts = msg_len;
 	msg_ptr->m_type = msg_prio;
 
+	/* msg_insert() may need a new tree node, don't allocate it locked */
+	if (!info->node_cache)
+		new_leaf = msg_tree_node_alloc();
+
 	spin_lock(&info->lock);
+	new_leaf = msg_tree_node_cache(info, new_leaf);
 
 	if (info->attr.mq_curmsgs == info->attr.mq_maxmsg) {
 		if (filp->f_flags & O_NONBLOCK) {
@@ -925,7 +1031,12 @@ SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 			pipelined_send(info, msg_ptr, receiver);
 		} else {
 			/* adds message to the queue */
-			msg_insert(msg_ptr, info);
+			if (msg_insert(msg_ptr, info)) {
+				spin_unlock(&info->lock);
+				free_msg(msg_ptr);
+				ret = -ENOMEM;
+				goto out_free;
+			}
 			__do_notify(info);
 		}
 		inode->i_atime = inode->i_mtime = inode->i_ctime =
@@ -933,6 +1044,8 @@ SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 		spin_unlock(&info->lock);
 		ret = 0;
 	}
+out_free:
+	kfree(new_leaf);
 out_fput:
 	fput(filp);
 out:
@@ -950,6 +1063,7 @@ SYSCALL_DEFINE5(mq_timedreceive, mqd_t, mqdes, char __user *, u_msg_ptr,
 	struct inode *inode;
 	struct mqueue_inode_info *info;
 	struct ext_wait_queue wait;
+	struct posix_msg_tree_node *new_leaf = NULL;
 	struct timespec ts, *p = NULL;
 
 	if (u_abs_timeout) {
@@ -982,7 +1096,12 @@ SYSCALL_DEFINE5(mq_timedreceive, mqd_t, mqdes, char __user *, u_msg_ptr,
 		goto out_fput;
 	}
 
+	/* a waiting sender's message may need a new tree node */
+	if (!info->node_cache)
+		new_leaf = msg_tree_node_alloc();
+
 	spin_lock(&info->lock);
+	new_leaf = msg_tree_node_cache(info, new_leaf);
 	if (info->attr.mq_curmsgs == 0) {
 		if (filp->f_flags & O_NONBLOCK) {
 			spin_unlock(&info->lock);
@@ -1018,6 +1137,7 @@ SYSCALL_DEFINE5(mq_timedreceive, mqd_t, mqdes, char __user *, u_msg_ptr,
 		}
 		free_msg(msg_ptr);
 	}
+	kfree(new_leaf);
 out_fput:
 	fput(filp);
 out:
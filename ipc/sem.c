@@ -89,7 +89,6 @@
 
 #define sem_ids(ns)	((ns)->ids[IPC_SEM_IDS])
 
-#define sem_unlock(sma)		ipc_unlock(&(sma)->sem_perm)
 #define sem_checkid(sma, semid)	ipc_checkid(&sma->sem_perm, semid)
 
 static int newary(struct ipc_namespace *, struct ipc_params *);
@@ -102,10 +101,20 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
 #define SEMOPM_FAST	64  /* ~ 372 bytes on stack */
 
 /*
+ * Locking:
+ * Operations on a single semaphore (semop() with nsops == 1) only take
+ * that semaphore's sem.lock, as long as no multi-sop operation is
+ * pending or in progress. Everything else takes the array lock
+ * (sem_perm.lock) and switches the array into "complex mode":
+ * sem_array.complex_mode is set and all per-semaphore locks are waited
+ * for, so the holder of the array lock owns the whole array. The array
+ * stays in complex mode as long as multi-sop operations are queued.
+ *
  * linked list protection:
  *	sem_undo.id_next,
- *	sem_array.sem_pending{,last},
- *	sem_array.sem_undo: sem_lock() for read/write
+ *	sem_array.sem_pending (multi-sop operations),
+ *	sem_array.sem_undo: array lock for read/write
+ *	sem.sem_pending (single-sop operations): sem.lock or array lock
  *	sem_undo.proc_next: only "current" is allowed to read/write that field.
  *	
  */
@@ -141,41 +150,149 @@ void __init sem_init (void)
 				IPC_SEM_IDS, sysvipc_sem_proc_show);
 }
 
+/*
+ * Enter complex mode: called with the array lock held. Once all
+ * per-semaphore locks have been seen free, no single-sop fast path can
+ * be running, and new ones fall back to the array lock.
+ */
+static void sem_complexmode_enter(struct sem_array *sma)
+{
+	int i;
+
+	if (sma->complex_mode)
+		return;
+
+	sma->complex_mode = 1;
+	/* pairs with the barrier in sem_lock_sops() */
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+	smp_rmb();
+}
+
+/*
+ * Leave complex mode before dropping the array lock, unless multi-sop
+ * operations are still queued: those must see every change to the array.
+ */
+static void sem_complexmode_tryleave(struct sem_array *sma)
+{
+	if (sma->complex_count)
+		return;
+
+	/* our updates must be visible before the fast path is reopened */
+	smp_mb();
+	sma->complex_mode = 0;
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rw_mutex
- * is not held.
+ * is not held. They return with the array lock held, in complex mode.
  */
 static inline struct sem_array *sem_lock(struct ipc_namespace *ns, int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_complexmode_enter(sma);
+	return sma;
 }
 
 static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 						int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock_check(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_complexmode_enter(sma);
+	return sma;
+}
+
+static inline void sem_unlock(struct sem_array *sma)
+{
+	sem_complexmode_tryleave(sma);
+	ipc_unlock(&sma->sem_perm);
+}
+
+/*
+ * sem_lock_sops - lock a semaphore array for a semop() call
+ * @sma: semaphore array, found under rcu_read_lock()
+ * @sops: the operations
+ * @nsops: number of operations
+ *
+ * A single-sop operation only takes the lock of the semaphore it works
+ * on, unless the array is in complex mode. Returns the number of the
+ * locked semaphore, or -1 if the array lock was taken instead. The
+ * caller must check sem_perm.deleted afterwards and unlock with
+ * sem_unlock_sops().
+ */
+static int sem_lock_sops(struct sem_array *sma, struct sembuf *sops,
+			 int nsops)
+{
+	struct sem *sem;
+
+	if (nsops != 1) {
+		spin_lock(&sma->sem_perm.lock);
+		sem_complexmode_enter(sma);
+		return -1;
+	}
+
+	sem = sma->sem_base + sops->sem_num;
+
+	if (!ACCESS_ONCE(sma->complex_mode)) {
+		spin_lock(&sem->lock);
+		/* pairs with the barrier in sem_complexmode_enter() */
+		smp_mb();
+		if (!ACCESS_ONCE(sma->complex_mode)) {
+			smp_rmb();
+			return sops->sem_num;
+		}
+		spin_unlock(&sem->lock);
+	}
+
+	spin_lock(&sma->sem_perm.lock);
+	if (!sma->sem_perm.deleted && !sma->complex_count) {
+		/*
+		 * Nobody else can be in complex mode while we hold the
+		 * array lock, and no multi-sop operation is queued:
+		 * switch to the per-semaphore lock.
+		 */
+		sem_complexmode_tryleave(sma);
+		spin_lock(&sem->lock);
+		spin_unlock(&sma->sem_perm.lock);
+		return sops->sem_num;
+	}
+	sem_complexmode_enter(sma);
+	return -1;
+}
+
+static void sem_unlock_sops(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1) {
+		sem_complexmode_tryleave(sma);
+		spin_unlock(&sma->sem_perm.lock);
+	} else
+		spin_unlock(&sma->sem_base[locknum].lock);
 }
 
 static inline void sem_lock_and_putref(struct sem_array *sma)
 {
 	ipc_lock_by_ptr(&sma->sem_perm);
 	ipc_rcu_putref(sma);
+	sem_complexmode_enter(sma);
 }
 
 static inline void sem_getref_and_unlock(struct sem_array *sma)
 {
 	ipc_rcu_getref(sma);
-	ipc_unlock(&(sma)->sem_perm);
+	sem_unlock(sma);
 }
 
 static inline void sem_putref(struct sem_array *sma)
@@ -190,12 +307,27 @@ static inline void sem_rmid(struct ipc_namespace *ns, struct sem_array *s)
 	ipc_rmid(&sem_ids(ns), &s->sem_perm);
 }
 
+/*
+ * sem_obtain_object_check - look up a semaphore array without locking it.
+ * Must be called with rcu_read_lock() held.
+ */
+static inline struct sem_array *sem_obtain_object_check(struct ipc_namespace *ns,
+							int id)
+{
+	struct kern_ipc_perm *ipcp = ipc_obtain_object_check(&sem_ids(ns), id);
+
+	if (IS_ERR(ipcp))
+		return (struct sem_array *)ipcp;
+
+	return container_of(ipcp, struct sem_array, sem_perm);
+}
+
 /*
  * Lockless wakeup algorithm:
  * Without the check/retry algorithm a lockless wakeup is possible:
  * - queue.status is initialized to -EINTR before blocking.
  * - wakeup is performed by
- *	* unlinking the queue entry from sma->sem_pending
+ *	* unlinking the queue entry from its pending queue
  *	* setting queue.status to IN_WAKEUP
  *	  This is the notification for the blocked thread that a
  *	  result value is imminent.
@@ -241,6 +373,7 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 	key_t key = params->key;
 	int nsems = params->u.nsems;
 	int semflg = params->flg;
+	int i;
 
 	if (!nsems)
 		return -EINVAL;
@@ -273,6 +406,10 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 	ns->used_sems += nsems;
 
 	sma->sem_base = (struct sem *) &sma[1];
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
+		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
 	INIT_LIST_HEAD(&sma->sem_pending);
 	INIT_LIST_HEAD(&sma->list_id);
 	sma->sem_nsems = nsems;
@@ -398,64 +535,110 @@ undo:
 	return result;
 }
 
-/* Go through the pending queue for the indicated semaphore
- * looking for tasks that can be completed.
+static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
+{
+	list_del(&q->list);
+	if (q->nsops > 1)
+		sma->complex_count--;
+}
+
+static void wake_up_sem_queue(struct sem_queue *q, int error)
+{
+	q->status = IN_WAKEUP;
+
+	wake_up_process(q->sleeper);
+	/* hands-off: q will disappear immediately after
+	 * writing q->status.
+	 */
+	smp_wmb();
+	q->status = error;
+}
+
+/**
+ * update_queue - look for tasks that can be completed
+ * @sma: semaphore array
+ * @semnum: semaphore whose queue of single-sop operations is scanned,
+ *	    or -1 for the queue of multi-sop operations
+ *
+ * The caller must hold the lock that protects the scanned queue.
+ * Returns 1 if a completed operation modified the array.
  */
-static void update_queue (struct sem_array * sma)
+static int update_queue(struct sem_array *sma, int semnum)
 {
-	int error;
-	struct sem_queue * q;
+	struct list_head *pending;
+	struct sem_queue *q, *n;
+	int error, alter, altered = 0;
+
+	if (semnum == -1)
+		pending = &sma->sem_pending;
+	else
+		pending = &sma->sem_base[semnum].sem_pending;
+
+again:
+	list_for_each_entry_safe(q, n, pending, list) {
+		/*
+		 * Wait-for-zero operations are queued at the head, the
+		 * others at the tail. Increments never block, so if the
+		 * semaphore of a single-sop queue is 0 none of the
+		 * remaining operations can succeed.
+		 */
+		if (semnum != -1 && q->alter &&
+		    !sma->sem_base[semnum].semval)
+			break;
 
-	q = list_entry(sma->sem_pending.next, struct sem_queue, list);
-	while (&q->list != &sma->sem_pending) {
 		error = try_atomic_semop(sma, q->sops, q->nsops,
 					 q->undo, q->pid);
 
 		/* Does q->sleeper still need to sleep? */
-		if (error <= 0) {
-			struct sem_queue *n;
+		if (error > 0)
+			continue;
 
-			/*
-			 * Continue scanning. The next operation
-			 * that must be checked depends on the type of the
-			 * completed operation:
-			 * - if the operation modified the array, then
-			 *   restart from the head of the queue and
-			 *   check for threads that might be waiting
-			 *   for semaphore values to become 0.
-			 * - if the operation didn't modify the array,
-			 *   then just continue.
-			 * The order of list_del() and reading ->next
-			 * is crucial: In the former case, the list_del()
-			 * must be done first [because we might be the
-			 * first entry in ->sem_pending], in the latter
-			 * case the list_del() must be done last
-			 * [because the list is invalid after the list_del()]
-			 */
-			if (q->alter) {
-				list_del(&q->list);
-				n = list_entry(sma->sem_pending.next,
-						struct sem_queue, list);
-			} else {
-				n = list_entry(q->list.next, struct sem_queue,
-						list);
-				list_del(&q->list);
-			}
+		unlink_queue(sma, q);
+		alter = q->alter;
+		wake_up_sem_queue(q, error);
+
+		/*
+		 * If the operation modified the array, restart from the
+		 * head of the queue and check for threads that might be
+		 * waiting for semaphore values to become 0.
+		 */
+		if (alter && !error) {
+			altered = 1;
+			goto again;
+		}
+	}
 
-			/* wake up the waiting thread */
-			q->status = IN_WAKEUP;
+	return altered;
+}
 
-			wake_up_process(q->sleeper);
-			/* hands-off: q will disappear immediately after
-			 * writing q->status.
-			 */
-			smp_wmb();
-			q->status = error;
-			q = n;
-		} else {
-			q = list_entry(q->list.next, struct sem_queue, list);
-		}
+/**
+ * do_smart_update - complete pending operations after a modification
+ * @sma: semaphore array
+ * @sops: the operations that modified the array, or NULL if any
+ *	  semaphore may have changed
+ * @nsops: number of operations
+ *
+ * Without multi-sop operations queued, only the single-sop queues of
+ * the modified semaphores can make progress, and completing those does
+ * not affect any other semaphore. Otherwise every queue is scanned
+ * until nothing changes anymore, which requires the array lock.
+ */
+static void do_smart_update(struct sem_array *sma, struct sembuf *sops,
+			    int nsops)
+{
+	int i, altered;
+
+	if (!sma->complex_count && sops) {
+		for (i = 0; i < nsops; i++)
+			update_queue(sma, sops[i].sem_num);
+		return;
 	}
+
+	do {
+		altered = update_queue(sma, -1);
+		for (i = 0; i < sma->sem_nsems; i++)
+			altered |= update_queue(sma, i);
+	} while (altered);
 }
 
 /* The following counts are associated to each semaphore:
@@ -467,42 +650,34 @@ static void update_queue (struct sem_array * sma)
  * The counts we return here are a rough approximation, but still
  * warrant that semncnt+semzcnt>0 if the task is on the pending queue.
  */
-static int count_semncnt (struct sem_array * sma, ushort semnum)
+static int count_queue(struct list_head *pending, ushort semnum, int zero)
 {
-	int semncnt;
+	int cnt = 0;
 	struct sem_queue * q;
 
-	semncnt = 0;
-	list_for_each_entry(q, &sma->sem_pending, list) {
+	list_for_each_entry(q, pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
 		int i;
 		for (i = 0; i < nsops; i++)
 			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op < 0)
+			    && (zero ? sops[i].sem_op == 0 : sops[i].sem_op < 0)
 			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semncnt++;
+				cnt++;
 	}
-	return semncnt;
+	return cnt;
 }
 
-static int count_semzcnt (struct sem_array * sma, ushort semnum)
+static int count_semncnt (struct sem_array * sma, ushort semnum)
 {
-	int semzcnt;
-	struct sem_queue * q;
+	return count_queue(&sma->sem_base[semnum].sem_pending, semnum, 0) +
+	       count_queue(&sma->sem_pending, semnum, 0);
+}
 
-	semzcnt = 0;
-	list_for_each_entry(q, &sma->sem_pending, list) {
-		struct sembuf * sops = q->sops;
-		int nsops = q->nsops;
-		int i;
-		for (i = 0; i < nsops; i++)
-			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op == 0)
-			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semzcnt++;
-	}
-	return semzcnt;
+static int count_semzcnt (struct sem_array * sma, ushort semnum)
+{
+	return count_queue(&sma->sem_base[semnum].sem_pending, semnum, 1) +
+	       count_queue(&sma->sem_pending, semnum, 1);
 }
 
 static void free_un(struct rcu_head *head)
@@ -520,9 +695,11 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 	struct sem_undo *un, *tu;
 	struct sem_queue *q, *tq;
 	struct sem_array *sma = container_of(ipcp, struct sem_array, sem_perm);
+	int i;
 
 	/* Free the existing undo structures for this semaphore set.  */
 	assert_spin_locked(&sma->sem_perm.lock);
+	sem_complexmode_enter(sma);
 	list_for_each_entry_safe(un, tu, &sma->list_id, list_id) {
 		list_del(&un->list_id);
 		spin_lock(&un->ulp->lock);
@@ -534,12 +711,16 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 
 	/* Wake up all pending processes and let them fail with EIDRM. */
 	list_for_each_entry_safe(q, tq, &sma->sem_pending, list) {
-		list_del(&q->list);
+		unlink_queue(sma, q);
+		wake_up_sem_queue(q, -EIDRM);
+	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
 
-		q->status = IN_WAKEUP;
-		wake_up_process(q->sleeper); /* doesn't sleep */
-		smp_wmb();
-		q->status = -EIDRM;	/* hands-off q */
+		list_for_each_entry_safe(q, tq, &sem->sem_pending, list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue(q, -EIDRM);
+		}
 	}
 
 	/* Remove the semaphore set from the IDR */
@@ -762,7 +943,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 		}
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		err = 0;
 		goto out_unlock;
 	}
@@ -791,6 +972,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 	{
 		int val = arg.val;
 		struct sem_undo *un;
+		struct sembuf sop = { .sem_num = semnum };
 
 		err = -ERANGE;
 		if (val > SEMVMX || val < 0)
@@ -804,7 +986,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 		curr->sempid = task_tgid_vnr(current);
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, &sop, 1);
 		err = 0;
 		goto out_unlock;
 	}
@@ -1070,6 +1252,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	struct sem_queue queue;
 	unsigned long jiffies_left = 0;
 	struct ipc_namespace *ns;
+	int locknum;
 
 	ns = current->nsproxy->ipc_ns;
 
@@ -1109,23 +1292,38 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 			alter = 1;
 	}
 
+	/* find_alloc_undo returns with rcu_read_lock() held */
 	if (undos) {
 		un = find_alloc_undo(ns, semid);
 		if (IS_ERR(un)) {
 			error = PTR_ERR(un);
 			goto out_free;
 		}
-	} else
+	} else {
 		un = NULL;
+		rcu_read_lock();
+	}
 
-	sma = sem_lock_check(ns, semid);
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
-		if (un)
-			rcu_read_unlock();
+		rcu_read_unlock();
 		error = PTR_ERR(sma);
 		goto out_free;
 	}
 
+	/* sem_nsems is immutable, check it before indexing sem_base */
+	error = -EFBIG;
+	if (max >= sma->sem_nsems) {
+		rcu_read_unlock();
+		goto out_free;
+	}
+
+	locknum = sem_lock_sops(sma, sops, nsops);
+
+	error = -EIDRM;
+	if (sma->sem_perm.deleted)
+		goto out_unlock_free;
+
 	/*
 	 * semid identifiers are not unique - find_alloc_undo may have
 	 * allocated an undo structure, it was invalidated by an RMID
@@ -1133,26 +1331,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	 * This case can be detected checking un->semid. The existance of
 	 * "un" itself is guaranteed by rcu.
 	 */
-	error = -EIDRM;
-	if (un) {
-		if (un->semid == -1) {
-			rcu_read_unlock();
-			goto out_unlock_free;
-		} else {
-			/*
-			 * rcu lock can be released, "un" cannot disappear:
-			 * - sem_lock is acquired, thus IPC_RMID is
-			 *   impossible.
-			 * - exit_sem is impossible, it always operates on
-			 *   current (or a dead task).
-			 */
-
-			rcu_read_unlock();
-		}
-	}
-
-	error = -EFBIG;
-	if (max >= sma->sem_nsems)
+	if (un && un->semid == -1)
 		goto out_unlock_free;
 
 	error = -EACCES;
@@ -1166,12 +1345,13 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	error = try_atomic_semop (sma, sops, nsops, un, task_tgid_vnr(current));
 	if (error <= 0) {
 		if (alter && error == 0)
-			update_queue (sma);
+			do_smart_update(sma, sops, nsops);
 		goto out_unlock_free;
 	}
 
 	/* We need to sleep on this operation, so we put the current
-	 * task into the pending queue and go to sleep.
+	 * task into the pending queue and go to sleep. Single-sop
+	 * operations wait on the queue of their semaphore.
 	 */
 		
 	queue.sops = sops;
@@ -1179,15 +1359,26 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	queue.undo = un;
 	queue.pid = task_tgid_vnr(current);
 	queue.alter = alter;
-	if (alter)
-		list_add_tail(&queue.list, &sma->sem_pending);
-	else
-		list_add(&queue.list, &sma->sem_pending);
+	if (nsops == 1) {
+		struct sem *curr = sma->sem_base + sops->sem_num;
+
+		if (alter)
+			list_add_tail(&queue.list, &curr->sem_pending);
+		else
+			list_add(&queue.list, &curr->sem_pending);
+	} else {
+		if (alter)
+			list_add_tail(&queue.list, &sma->sem_pending);
+		else
+			list_add(&queue.list, &sma->sem_pending);
+		sma->complex_count++;
+	}
 
 	queue.status = -EINTR;
 	queue.sleeper = current;
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	sem_unlock_sops(sma, locknum);
+	rcu_read_unlock();
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1206,12 +1397,16 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 		goto out_free;
 	}
 
-	sma = sem_lock(ns, semid);
+	rcu_read_lock();
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
+		rcu_read_unlock();
 		error = -EIDRM;
 		goto out_free;
 	}
 
+	locknum = sem_lock_sops(sma, sops, nsops);
+
 	/*
 	 * If queue.status != -EINTR we are woken up by another process
 	 */
@@ -1225,10 +1420,11 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	 */
 	if (timeout && jiffies_left == 0)
 		error = -EAGAIN;
-	list_del(&queue.list);
+	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma);
+	sem_unlock_sops(sma, locknum);
+	rcu_read_unlock();
 out_free:
 	if(sops != fast_sops)
 		kfree(sops);
@@ -1354,7 +1550,7 @@ void exit_sem(struct task_struct *tsk)
 		}
 		sma->sem_otime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		sem_unlock(sma);
 
 		call_rcu(&un->rcu, free_un);
@@ -731,6 +731,30 @@ struct kern_ipc_perm *ipc_lock_check(struct ipc_ids *ids, int id)
 	return out;
 }
 
+/**
+ * ipc_obtain_object_check - Look up an ipc structure without locking it
+ * @ids: IPC identifier set
+ * @id: ipc id to look for
+ *
+ * Like ipc_lock_check(), but the object is neither locked nor checked
+ * for deletion: the caller must be inside an rcu_read_lock() section
+ * and must check ->deleted under whatever lock it takes afterwards.
+ */
+struct kern_ipc_perm *ipc_obtain_object_check(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *out;
+	int lid = ipcid_to_idx(id);
+
+	out = idr_find(&ids->ipcs_idr, lid);
+	if (out == NULL)
+		return ERR_PTR(-EINVAL);
+
+	if (ipc_checkid(out, id))
+		return ERR_PTR(-EIDRM);
+
+	return out;
+}
+
 /**
  * ipcget - Common sys_*get() code
  * @ns : namsepace
@@ -761,15 +761,15 @@ int audit_tag_tree(char *old, char *new)
 			continue;
 		}
 
-		spin_lock(&vfsmount_lock);
+		br_read_lock(vfsmount_lock);
 		if (!is_under(mnt, dentry, &path)) {
-			spin_unlock(&vfsmount_lock);
+			br_read_unlock(vfsmount_lock);
 			path_put(&path);
 			put_tree(tree);
 			mutex_lock(&audit_filter_mutex);
 			continue;
 		}
-		spin_unlock(&vfsmount_lock);
+		br_read_unlock(vfsmount_lock);
 		path_put(&path);
 
 		list_for_each_entry(p, &list, mnt_list) {
@@ -1198,6 +1198,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 #endif
 	INIT_LIST_HEAD(&p->pi_state_list);
 	p->pi_state_cache = NULL;
+	p->futex_wake = NULL;
 #endif
 	/*
 	 * sigaltstack should be cleared when sharing the same VM
@@ -59,6 +59,7 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/bootmem.h>
 
 #include <asm/futex.h>
 
@@ -66,8 +67,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Priority Inheritance state:
  */
@@ -130,9 +129,16 @@ struct futex_q {
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+/*
+ * The hash table is sized at boot from the number of possible cpus and
+ * allocated with alloc_large_system_hash(), which spreads it over all
+ * nodes when hashdist is in effect.  Each bucket sits on its own cache
+ * line so unrelated futexes don't bounce each other's lock around.
+ */
+static struct futex_hash_bucket *futex_queues __read_mostly;
+static unsigned long futex_hashsize __read_mostly;
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
@@ -142,7 +148,7 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
 /*
@@ -767,22 +773,85 @@ retry:
 	return ret;
 }
 
+/*
+ * Wakeups are collected on a singly linked list threaded through
+ * task_struct::futex_wake while the hash bucket lock is held and
+ * delivered by wake_futex_list() once it has been dropped, so that the
+ * woken tasks don't immediately pile up on hb->lock.  The list is
+ * terminated by FUTEX_WAKE_TAIL rather than NULL so that a NULL link
+ * means "not queued".
+ */
+#define FUTEX_WAKE_TAIL		((struct task_struct *)0x01)
+
+struct futex_wake_list {
+	struct task_struct *first;
+	struct task_struct **lastp;
+};
+
+#define FUTEX_WAKE_LIST(name)					\
+	struct futex_wake_list name = { FUTEX_WAKE_TAIL, &name.first }
+
+static void futex_wake_list_add(struct futex_wake_list *head,
+				struct task_struct *p)
+{
+	/*
+	 * A task which got woken up spuriously may have queued itself
+	 * on another futex and been picked by another waker while it
+	 * is still on an earlier wake list.  That earlier wakeup is
+	 * issued after the link is cleared and will do for both, so
+	 * just skip it here.
+	 */
+	if (cmpxchg(&p->futex_wake, NULL, FUTEX_WAKE_TAIL))
+		return;
+
+	/* Paired with put_task_struct() in wake_futex_list() */
+	get_task_struct(p);
+	*head->lastp = p;
+	head->lastp = &p->futex_wake;
+}
+
+static void wake_futex_list(struct futex_wake_list *head)
+{
+	struct task_struct *p = head->first;
+
+	while (p != FUTEX_WAKE_TAIL) {
+		struct task_struct *next = p->futex_wake;
+
+		/*
+		 * Clear the link before waking so that a later
+		 * futex_wake_list_add() is guaranteed to see the task
+		 * as no longer queued once the wakeup has been issued.
+		 */
+		p->futex_wake = NULL;
+		/*
+		 * Order the store above against try_to_wake_up() reading
+		 * p->state.  Pairs with the cmpxchg() in
+		 * futex_wake_list_add().
+		 */
+		smp_mb();
+		wake_up_state(p, TASK_NORMAL);
+		put_task_struct(p);
+		p = next;
+	}
+}
+
 /*
  * The hash bucket lock must be held when this is called.
- * Afterwards, the futex_q must not be accessed.
+ * Afterwards, the futex_q must not be accessed.  The task is woken by
+ * wake_futex_list() after the caller has dropped the lock.
  */
-static void wake_futex(struct futex_q *q)
+static void mark_wake_futex(struct futex_wake_list *wake_list,
+			    struct futex_q *q)
 {
 	struct task_struct *p = q->task;
 
 	/*
-	 * We set q->lock_ptr = NULL _before_ we wake up the task. If
-	 * a non futex wake up happens on another CPU then the task
-	 * might exit and p would dereference a non existing task
-	 * struct. Prevent this by holding a reference on p across the
-	 * wake up.
+	 * Queue the task, which takes a reference on it, _before_
+	 * q->lock_ptr is cleared.  Once that happens the task may
+	 * return from the futex call and exit, and p would be a stale
+	 * pointer.
 	 */
-	get_task_struct(p);
+	futex_wake_list_add(wake_list, p);
 
 	plist_del(&q->list, &q->list.plist);
 	/*
@@ -793,9 +862,6 @@ static void wake_futex(struct futex_q *q)
 	 */
 	smp_wmb();
 	q->lock_ptr = NULL;
-
-	wake_up_state(p, TASK_NORMAL);
-	put_task_struct(p);
 }
 
 static int wake_futex_pi(u32 __user *uaddr, u32 uval, struct futex_q *this)
@@ -916,6 +982,7 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 	struct futex_q *this, *next;
 	struct plist_head *head;
 	union futex_key key = FUTEX_KEY_INIT;
+	FUTEX_WAKE_LIST(wake_list);
 	int ret;
 
 	if (!bitset)
@@ -940,13 +1007,14 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 			if (!(this->bitset & bitset))
 				continue;
 
-			wake_futex(this);
+			mark_wake_futex(&wake_list, this);
 			if (++ret >= nr_wake)
 				break;
 		}
 	}
 
 	spin_unlock(&hb->lock);
+	wake_futex_list(&wake_list);
 	put_futex_key(fshared, &key);
 out:
 	return ret;
@@ -964,6 +1032,7 @@ futex_wake_op(u32 __user *uaddr1, int fshared, u32 __user *uaddr2,
 	struct futex_hash_bucket *hb1, *hb2;
 	struct plist_head *head;
 	struct futex_q *this, *next;
+	FUTEX_WAKE_LIST(wake_list);
 	int ret, op_ret;
 
 retry:
@@ -1014,7 +1083,7 @@ retry_private:
 
 	plist_for_each_entry_safe(this, next, head, list) {
 		if (match_futex (&this->key, &key1)) {
-			wake_futex(this);
+			mark_wake_futex(&wake_list, this);
 			if (++ret >= nr_wake)
 				break;
 		}
@@ -1026,7 +1095,7 @@ retry_private:
 		op_ret = 0;
 		plist_for_each_entry_safe(this, next, head, list) {
 			if (match_futex (&this->key, &key2)) {
-				wake_futex(this);
+				mark_wake_futex(&wake_list, this);
 				if (++op_ret >= nr_wake2)
 					break;
 			}
@@ -1035,6 +1104,7 @@ retry_private:
 	}
 
 	double_unlock_hb(hb1, hb2);
+	wake_futex_list(&wake_list);
 out_put_keys:
 	put_futex_key(fshared, &key2);
 out_put_key1:
@@ -1196,6 +1266,7 @@ static int futex_requeue(u32 __user *uaddr1, int fshared, u32 __user *uaddr2,
 	struct futex_hash_bucket *hb1, *hb2;
 	struct plist_head *head1;
 	struct futex_q *this, *next;
+	FUTEX_WAKE_LIST(wake_list);
 	u32 curval2;
 
 	if (requeue_pi) {
@@ -1341,7 +1412,7 @@ retry_private:
 		 * woken by futex_unlock_pi().
 		 */
 		if (++task_count <= nr_wake && !requeue_pi) {
-			wake_futex(this);
+			mark_wake_futex(&wake_list, this);
 			continue;
 		}
 
@@ -1380,6 +1451,7 @@ retry_private:
 
 out_unlock:
 	double_unlock_hb(hb1, hb2);
+	wake_futex_list(&wake_list);
 
 	/*
 	 * drop_futex_key_refs() must be called outside the spinlocks. During
@@ -1923,6 +1995,212 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.flags & FLAGS_CLOCKRT);
 }
 
+/*
+ * State for one entry of a FUTEX_WAIT_MULTIPLE call: the user supplied
+ * futex_waitv and the futex_q we queue for it.
+ */
+struct futex_vector {
+	struct futex_waitv w;
+	struct futex_q q;
+};
+
+static inline int futex_vector_shared(struct futex_vector *v)
+{
+	return !(v->w.flags & FUTEX_PRIVATE_FLAG);
+}
+
+/**
+ * unqueue_multiple() - Remove the first @count futex_q's of @vs
+ * @vs:		the array of futex_vector
+ * @count:	the number of entries which were queued with queue_me()
+ *
+ * Returns the index of the first entry which had already been woken,
+ * or -1 if none of them had.
+ */
+static int unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&vs[i].q) && ret < 0)
+			ret = i;
+	}
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Queue on all the futexes of @vs
+ * @vs:		the array of futex_vector, keys already set up
+ * @count:	the number of entries in @vs
+ * @fault:	set if a futex value could not be read atomically
+ *
+ * Must be called in TASK_INTERRUPTIBLE so that a wakeup on an entry
+ * which is already queued is not lost while the others are set up.
+ * Every entry is either queued or has had its key reference dropped
+ * when this returns.
+ *
+ * If reading a futex value faults, everything is undone, the page is
+ * faulted in and *@fault is set so that the caller starts over.
+ *
+ * Returns:
+ *  0 - all the futexes were queued, or *@fault was set
+ * >0 - the index + 1 of an entry which was woken during setup
+ * <0 - -EWOULDBLOCK (a futex did not contain the expected value) or
+ *      -EFAULT; the task state is TASK_RUNNING
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *fault)
+{
+	struct futex_hash_bucket *hb;
+	u32 __user *uaddr;
+	int i, j, ret;
+	u32 uval;
+
+	for (i = 0; i < count; i++) {
+		uaddr = (u32 __user *)(unsigned long)vs[i].w.uaddr;
+
+		hb = queue_lock(&vs[i].q);
+		ret = get_futex_value_locked(&uval, uaddr);
+		if (!ret && uval == vs[i].w.val) {
+			queue_me(&vs[i].q, hb);
+			continue;
+		}
+		queue_unlock(&vs[i].q, hb);
+
+		__set_current_state(TASK_RUNNING);
+		j = unqueue_multiple(vs, i);
+		for (; i < count; i++)
+			put_futex_key(futex_vector_shared(&vs[i]), &vs[i].q.key);
+		if (j >= 0)
+			return j + 1;
+		if (ret) {
+			/* Fault it in and let the caller start over */
+			*fault = 1;
+			return get_user(uval, uaddr);
+		}
+		return -EWOULDBLOCK;
+	}
+	return 0;
+}
+
+/*
+ * Block until any one of the futexes described by the user array
+ * @uwaitv is woken, the absolute @abs_time expires or a signal arrives.
+ * Returns the index of the woken futex.
+ */
+static int futex_wait_multiple(struct futex_waitv __user *uwaitv,
+			       unsigned int count, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_vector *vs;
+	int fault, ret, i;
+
+	if (!count || count > FUTEX_WAITV_MAX)
+		return -EINVAL;
+
+	vs = kcalloc(count, sizeof(*vs), GFP_KERNEL);
+	if (!vs)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		ret = -EFAULT;
+		if (copy_from_user(&vs[i].w, &uwaitv[i], sizeof(vs[i].w)))
+			goto out_free;
+		ret = -EINVAL;
+		if (vs[i].w.flags & ~FUTEX_PRIVATE_FLAG)
+			goto out_free;
+		if ((unsigned long)vs[i].w.uaddr != vs[i].w.uaddr)
+			goto out_free;
+		vs[i].q.bitset = FUTEX_BITSET_MATCH_ANY;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+retry:
+	for (i = 0; i < count; i++) {
+		vs[i].q.key = FUTEX_KEY_INIT;
+		ret = get_futex_key((u32 __user *)(unsigned long)vs[i].w.uaddr,
+				    futex_vector_shared(&vs[i]), &vs[i].q.key,
+				    VERIFY_READ);
+		if (unlikely(ret)) {
+			while (--i >= 0)
+				put_futex_key(futex_vector_shared(&vs[i]),
+					      &vs[i].q.key);
+			goto out;
+		}
+	}
+
+	fault = 0;
+	set_current_state(TASK_INTERRUPTIBLE);
+	ret = futex_wait_multiple_setup(vs, count, &fault);
+	if (ret > 0) {
+		ret--;
+		goto out;
+	}
+	if (ret)
+		goto out;
+	if (fault)
+		goto retry;
+
+	/* Arm the timer */
+	if (to) {
+		hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+		if (!hrtimer_active(&to->timer))
+			to->task = NULL;
+	}
+
+	/*
+	 * Only sleep if none of the futexes has been woken while we were
+	 * queueing on the others and the timer has not already expired.
+	 */
+	for (i = 0; i < count; i++) {
+		if (plist_node_empty(&vs[i].q.list))
+			break;
+	}
+	if (i == count && (!to || to->task))
+		schedule();
+	__set_current_state(TASK_RUNNING);
+
+	/* unqueue_multiple() drops the key refs */
+	ret = unqueue_multiple(vs, count);
+	if (ret >= 0)
+		goto out;
+
+	ret = -ETIMEDOUT;
+	if (to && !to->task)
+		goto out;
+
+	/*
+	 * We expect signal_pending(current), but we might be the
+	 * victim of a spurious wakeup as well.
+	 */
+	if (!signal_pending(current))
+		goto retry;
+
+	/*
+	 * The timeout was relative to the original call, so don't
+	 * restart transparently if there is one.
+	 */
+	ret = abs_time ? -EINTR : -ERESTARTSYS;
+
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out_free:
+	kfree(vs);
+	return ret;
+}
+
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -2641,6 +2919,10 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		ret = futex_requeue(uaddr, fshared, uaddr2, val, val2, &val3,
 				    1);
 		break;
+	case FUTEX_WAIT_MULTIPLE:
+		ret = futex_wait_multiple((struct futex_waitv __user *)uaddr,
+					  val, timeout);
+		break;
 	default:
 		ret = -ENOSYS;
 	}
@@ -2659,14 +2941,15 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&ts))
 			return -EINVAL;
 
 		t = timespec_to_ktime(ts);
-		if (cmd == FUTEX_WAIT)
+		if (cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_MULTIPLE)
 			t = ktime_add_safe(ktime_get(), t);
 		tp = &t;
 	}
@@ -2683,8 +2966,21 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
+	unsigned long i;
 	u32 curval;
-	int i;
+
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL, futex_hashsize);
+	/* alloc_large_system_hash() may have handed us fewer buckets */
+	futex_hashsize = 1UL << futex_shift;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2700,7 +2996,7 @@ static int __init futex_init(void)
 	if (curval == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	for (i = 0; i < futex_hashsize; i++) {
 		plist_head_init(&futex_queues[i].chain, &futex_queues[i].lock);
 		spin_lock_init(&futex_queues[i].lock);
 	}
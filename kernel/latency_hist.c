@@ -0,0 +1,241 @@
+/*
+ * kernel/latency_hist.c
+ *
+ * Per-cpu scheduler latency histograms, exported through debugfs:
+ *
+ *	sched_latency/enable		0/1, histograms are updated when set
+ *	sched_latency/<type>/cpuN	histogram of cpu N
+ *	sched_latency/<type>/all	sum over all cpus
+ *
+ * where <type> is wakeup, rqwait and, when the corresponding tracers
+ * are configured in, preemptoff and irqsoff. Writing anything to a file
+ * resets the histogram(s) it shows.
+ *
+ * The per-task-group view of the wakeup and rqwait histograms lives in
+ * the cpu cgroup controller (cpu.latency_hist).
+ */
+#include <linux/latency_hist.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+
+struct latency_hist_cpu {
+	struct latency_hist	hist[NR_LATENCY_HISTS];
+	u64			preempt_start;
+	u64			irqs_start;
+};
+
+static DEFINE_PER_CPU(struct latency_hist_cpu, latency_hist_cpu);
+
+u32 latency_hist_enabled __read_mostly = 1;
+
+static const char *latency_hist_names[NR_LATENCY_HISTS] = {
+	[LATENCY_HIST_WAKEUP]		= "wakeup",
+	[LATENCY_HIST_RQWAIT]		= "rqwait",
+	[LATENCY_HIST_PREEMPTOFF]	= "preemptoff",
+	[LATENCY_HIST_IRQSOFF]		= "irqsoff",
+};
+
+/*
+ * Must be called from a context that cannot migrate.
+ */
+void notrace latency_hist_record(enum latency_hist_type type, u64 delta)
+{
+	latency_hist_add(&__get_cpu_var(latency_hist_cpu).hist[type], delta);
+}
+
+/*
+ * The preempt-off and irqs-off hooks are called from the preempt and
+ * irqflags tracer entry points, which already tell outermost sections
+ * apart (preempt) or may nest (irqs): only the first "off" starts a
+ * section and only the matching "on" ends it.
+ */
+void notrace latency_hist_preempt_off(void)
+{
+	struct latency_hist_cpu *lh = &__get_cpu_var(latency_hist_cpu);
+
+	if (latency_hist_enabled && !lh->preempt_start)
+		lh->preempt_start = sched_clock() ? : 1;
+}
+
+void notrace latency_hist_preempt_on(void)
+{
+	struct latency_hist_cpu *lh = &__get_cpu_var(latency_hist_cpu);
+	u64 start = lh->preempt_start;
+
+	if (!start)
+		return;
+	lh->preempt_start = 0;
+	if (latency_hist_enabled)
+		latency_hist_add(&lh->hist[LATENCY_HIST_PREEMPTOFF],
+				 sched_clock() - start);
+}
+
+void notrace latency_hist_irqs_off(void)
+{
+	struct latency_hist_cpu *lh = &__get_cpu_var(latency_hist_cpu);
+
+	if (latency_hist_enabled && !lh->irqs_start)
+		lh->irqs_start = sched_clock() ? : 1;
+}
+
+void notrace latency_hist_irqs_on(void)
+{
+	struct latency_hist_cpu *lh = &__get_cpu_var(latency_hist_cpu);
+	u64 start = lh->irqs_start;
+
+	if (!start)
+		return;
+	lh->irqs_start = 0;
+	if (latency_hist_enabled)
+		latency_hist_add(&lh->hist[LATENCY_HIST_IRQSOFF],
+				 sched_clock() - start);
+}
+
+/**
+ * latency_hist_print - print a histogram to a seq_file
+ * @m:		the seq_file
+ * @hist:	the histogram
+ *
+ * One line per bucket up to the last non-empty one: the lower and upper
+ * bound of the bucket in nanoseconds and the number of samples.
+ */
+void latency_hist_print(struct seq_file *m, const struct latency_hist *hist)
+{
+	int i, last = 0;
+
+	for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+		if (hist->count[i])
+			last = i;
+
+	seq_printf(m, "#%19s %20s %20s\n", ">= ns", "< ns", "samples");
+	for (i = 0; i <= last; i++) {
+		u64 lo = i ? 1ULL << (i - 1) : 0;
+
+		if (i == LATENCY_HIST_BUCKETS - 1)
+			seq_printf(m, "%20llu %20s %20lu\n",
+				   lo, "inf", hist->count[i]);
+		else
+			seq_printf(m, "%20llu %20llu %20lu\n",
+				   lo, i ? 1ULL << i : 1ULL, hist->count[i]);
+	}
+}
+
+/*
+ * debugfs files encode the histogram type and the cpu (or -1 for the
+ * sum over all cpus) in i_private.
+ */
+#define LH_FILE(type, cpu)	((void *)(long)(((cpu) + 1) << 8 | (type)))
+#define LH_TYPE(priv)		((long)(priv) & 0xff)
+#define LH_CPU(priv)		(((long)(priv) >> 8) - 1)
+
+static int latency_hist_show(struct seq_file *m, void *v)
+{
+	int type = LH_TYPE(m->private), cpu = LH_CPU(m->private);
+	struct latency_hist *sum;
+
+	if (cpu >= 0) {
+		latency_hist_print(m, &per_cpu(latency_hist_cpu, cpu).hist[type]);
+		return 0;
+	}
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu)
+		latency_hist_merge(sum, &per_cpu(latency_hist_cpu, cpu).hist[type]);
+	latency_hist_print(m, sum);
+	kfree(sum);
+
+	return 0;
+}
+
+static int latency_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, latency_hist_show, inode->i_private);
+}
+
+static ssize_t latency_hist_write(struct file *file, const char __user *ubuf,
+				  size_t cnt, loff_t *ppos)
+{
+	void *priv = ((struct seq_file *)file->private_data)->private;
+	int type = LH_TYPE(priv), cpu = LH_CPU(priv);
+
+	if (cpu >= 0) {
+		memset(&per_cpu(latency_hist_cpu, cpu).hist[type], 0,
+		       sizeof(struct latency_hist));
+	} else {
+		for_each_possible_cpu(cpu)
+			memset(&per_cpu(latency_hist_cpu, cpu).hist[type], 0,
+			       sizeof(struct latency_hist));
+	}
+
+	return cnt;
+}
+
+static const struct file_operations latency_hist_fops = {
+	.open		= latency_hist_open,
+	.read		= seq_read,
+	.write		= latency_hist_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static bool __init latency_hist_configured(int type)
+{
+	switch (type) {
+	case LATENCY_HIST_PREEMPTOFF:
+#ifdef CONFIG_PREEMPT_TRACER
+		return true;
+#else
+		return false;
+#endif
+	case LATENCY_HIST_IRQSOFF:
+#ifdef CONFIG_IRQSOFF_TRACER
+		return true;
+#else
+		return false;
+#endif
+	default:
+		return true;
+	}
+}
+
+static __init int latency_hist_init_debugfs(void)
+{
+	struct dentry *top, *dir;
+	char name[16];
+	int type, cpu;
+
+	top = debugfs_create_dir("sched_latency", NULL);
+	if (!top)
+		return 0;
+
+	debugfs_create_bool("enable", 0644, top, &latency_hist_enabled);
+
+	for (type = 0; type < NR_LATENCY_HISTS; type++) {
+		if (!latency_hist_configured(type))
+			continue;
+
+		dir = debugfs_create_dir(latency_hist_names[type], top);
+		if (!dir)
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			snprintf(name, sizeof(name), "cpu%d", cpu);
+			debugfs_create_file(name, 0644, dir,
+					    LH_FILE(type, cpu),
+					    &latency_hist_fops);
+		}
+		debugfs_create_file("all", 0644, dir, LH_FILE(type, -1),
+				    &latency_hist_fops);
+	}
+
+	return 0;
+}
+late_initcall(latency_hist_init_debugfs);
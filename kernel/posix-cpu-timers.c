@@ -8,8 +8,39 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * CPU timers are only checked from the tick: a nohz_full CPU running @p,
+ * or with @group any thread of @p, may have stopped its tick and has to
+ * re-evaluate it once a timer or RLIMIT_CPU is armed.  Called with
+ * p->sighand->siglock held.
+ */
+static void posix_cpu_timer_kick_nohz(struct task_struct *p, int group)
+{
+	struct task_struct *t = p;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	if (!group) {
+		tick_nohz_full_kick_timer(task_cpu(p));
+		return;
+	}
+
+	do {
+		tick_nohz_full_kick_timer(task_cpu(t));
+	} while_each_thread(p, t);
+}
+#else
+static inline void posix_cpu_timer_kick_nohz(struct task_struct *p,
+					     int group)
+{
+}
+#endif
+
 /*
  * Called after updating RLIMIT_CPU to set timer expiration if necessary.
  */
@@ -651,6 +682,9 @@ static void arm_timer(struct k_itimer *timer, union cpu_time_count now)
 				break;
 			}
 		}
+
+		posix_cpu_timer_kick_nohz(p,
+				!CPUCLOCK_PERTHREAD(timer->it_clock));
 	}
 
 	spin_unlock(&p->sighand->siglock);
@@ -1386,6 +1420,28 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return sig->rlim[RLIMIT_CPU].rlim_cur != RLIM_INFINITY;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/**
+ * posix_cpu_timers_can_stop_tick - may a nohz_full CPU stop its tick?
+ *
+ * @tsk:	The task running alone on the CPU.
+ *
+ * CPU timers are only ever checked from the tick, so it has to keep
+ * running while @tsk or its thread group has one armed, or while an
+ * RLIMIT_CPU limit is being enforced.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	struct signal_struct *sig = tsk->signal;
+
+	if (!task_cputime_zero(&tsk->cputime_expires) ||
+	    !task_cputime_zero(&sig->cputime_expires))
+		return false;
+
+	return sig->rlim[RLIMIT_CPU].rlim_cur == RLIM_INFINITY;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -1504,6 +1560,9 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			break;
 		}
 	}
+
+	/* also covers a newly finite RLIMIT_CPU, see update_rlimit_cpu() */
+	posix_cpu_timer_kick_nohz(tsk, 1);
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
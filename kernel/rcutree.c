@@ -46,6 +46,8 @@
 #include <linux/cpu.h>
 #include <linux/mutex.h>
 #include <linux/time.h>
+#include <linux/kthread.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 
@@ -220,6 +222,9 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
+	/* A nohz_full CPU only notices the grace period from its tick. */
+	tick_nohz_full_kick_cpu(rdp->cpu);
+
 	/* If preemptable RCU, no point in sending reschedule IPI. */
 	if (rdp->preemptable)
 		return 0;
@@ -1325,9 +1330,14 @@ static void rcu_process_callbacks(struct softirq_action *unused)
 	smp_mb(); /* See above block comment. */
 }
 
+/*
+ * Queue a callback for the specified flavor of RCU.  If the current CPU
+ * has its callbacks offloaded and @may_offload is set, the callback is
+ * handed to that CPU's rcuo kthread instead of the usual per-CPU lists.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, bool may_offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1345,6 +1355,10 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	 */
 	local_irq_save(flags);
 	rdp = rsp->rda[smp_processor_id()];
+	if (may_offload && __call_rcu_nocb(rdp, head)) {
+		local_irq_restore(flags);
+		return;
+	}
 	rcu_process_gp_end(rsp, rdp);
 	check_for_new_grace_period(rsp, rdp);
 
@@ -1385,7 +1399,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state);
+	__call_rcu(head, func, &rcu_sched_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1394,7 +1408,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1480,6 +1494,34 @@ int rcu_needs_cpu(int cpu)
 	       rcu_preempt_needs_cpu(cpu);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Does the specified CPU still owe RCU something that only its
+ * scheduling-clock tick will take care of: callbacks to advance, a
+ * quiescent state to report, or a grace-period change to notice?
+ * Unlike __rcu_pending(), this has no side effects, so the nohz_full
+ * code may check it on every interrupt exit.
+ */
+static int __rcu_needs_tick(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	return rdp->nxtlist || rdp->qs_pending ||
+	       ACCESS_ONCE(rsp->completed) != rdp->completed ||
+	       ACCESS_ONCE(rsp->gpnum) != rdp->gpnum;
+}
+
+/*
+ * Must the specified nohz_full CPU keep its tick running for RCU?
+ * This function is part of the RCU implementation; it is -not- an
+ * exported member of the RCU API.
+ */
+int rcu_needs_tick(int cpu)
+{
+	return __rcu_needs_tick(&rcu_sched_state, &per_cpu(rcu_sched_data, cpu)) ||
+	       __rcu_needs_tick(&rcu_bh_state, &per_cpu(rcu_bh_data, cpu)) ||
+	       rcu_preempt_needs_tick(cpu);
+}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head) = {NULL};
 static atomic_t rcu_barrier_cpu_count;
 static DEFINE_MUTEX(rcu_barrier_mutex);
@@ -1506,6 +1548,31 @@ static void rcu_barrier_func(void *type)
 	call_rcu_func(head, rcu_barrier_callback);
 }
 
+/*
+ * Offline CPUs whose callbacks are offloaded may still have callbacks
+ * queued for their rcuo kthread, which keeps running.  Queue a barrier
+ * callback behind them as well.  Must be called with preemption disabled
+ * so that the set of online CPUs cannot change.
+ */
+static void rcu_nocb_barrier_offline(struct rcu_state *rsp)
+{
+	struct rcu_head *head;
+	unsigned long flags;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (cpu_online(cpu) || !is_nocb_cpu(cpu))
+			continue;
+		head = &per_cpu(rcu_barrier_head, cpu);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		local_irq_save(flags);
+		__call_rcu_nocb(rsp->rda[cpu], head);
+		local_irq_restore(flags);
+	}
+}
+
 /*
  * Orchestrate the specified type of RCU barrier, waiting for all
  * RCU callbacks of the specified type to complete.
@@ -1531,6 +1598,7 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	preempt_disable(); /* stop CPU_DYING from filling orphan_cbs_list */
 	rcu_adopt_orphan_cbs(rsp);
 	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+	rcu_nocb_barrier_offline(rsp);
 	preempt_enable(); /* CPU_DYING can again fill orphan_cbs_list */
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
@@ -1578,6 +1646,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	rdp->dynticks = &per_cpu(rcu_dynticks, cpu);
 #endif /* #ifdef CONFIG_NO_HZ */
 	rdp->cpu = cpu;
+	rcu_boot_init_nocb_percpu_data(rdp, rsp);
 	spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -1788,6 +1857,7 @@ void __init __rcu_init(void)
 #ifdef CONFIG_RCU_CPU_STALL_DETECTOR
 	printk(KERN_INFO "RCU-based detection of stalled CPUs is enabled.\n");
 #endif /* #ifdef CONFIG_RCU_CPU_STALL_DETECTOR */
+	rcu_bootup_announce_nocb();
 	RCU_INIT_FLAVOR(&rcu_sched_state, rcu_sched_data);
 	RCU_INIT_FLAVOR(&rcu_bh_state, rcu_bh_data);
 	__rcu_init_preempt();
@@ -27,6 +27,7 @@
 #include <linux/threads.h>
 #include <linux/cpumask.h>
 #include <linux/seqlock.h>
+#include <linux/wait.h>
 
 /*
  * Define shape of hierarchy based on NR_CPUS and CONFIG_RCU_FANOUT.
@@ -200,6 +201,17 @@ struct rcu_data {
 	long n_rp_need_fqs;
 	long n_rp_need_nothing;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 6) Callback offloading. */
+	struct rcu_head *nocb_head;	/* CBs waiting for kthread. */
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;	/* # CBs waiting for kthread */
+	long nocb_p_count;		/* # CBs being invoked by kthread */
+	wait_queue_head_t nocb_wq;	/* For nocb kthreads to sleep on. */
+	struct task_struct *nocb_kthread;
+	struct rcu_state *nocb_rsp;	/* Flavor to wait on for GPs. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 };
 
@@ -320,8 +332,16 @@ static void rcu_preempt_process_callbacks(void);
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu));
 static int rcu_preempt_pending(int cpu);
 static int rcu_preempt_needs_cpu(int cpu);
+#ifdef CONFIG_NO_HZ_FULL
+static int rcu_preempt_needs_tick(int cpu);
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
 static void __cpuinit rcu_preempt_init_percpu_data(int cpu);
 static void rcu_preempt_send_cbs_to_orphanage(void);
 static void __init __rcu_init_preempt(void);
+static bool is_nocb_cpu(int cpu);
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp);
+static void __init rcu_bootup_announce_nocb(void);
 
 #endif /* #else #ifdef RCU_TREE_NONCORE */
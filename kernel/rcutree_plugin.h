@@ -394,7 +394,7 @@ static void rcu_preempt_process_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state);
+	__call_rcu(head, func, &rcu_preempt_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -427,6 +427,17 @@ static int rcu_preempt_needs_cpu(int cpu)
 	return !!per_cpu(rcu_preempt_data, cpu).nxtlist;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Does preemptable RCU need the scheduling-clock tick on a nohz_full CPU?
+ */
+static int rcu_preempt_needs_tick(int cpu)
+{
+	return __rcu_needs_tick(&rcu_preempt_state,
+				&per_cpu(rcu_preempt_data, cpu));
+}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 /**
  * rcu_barrier - Wait until all in-flight call_rcu() callbacks complete.
  */
@@ -610,6 +621,16 @@ static int rcu_preempt_needs_cpu(int cpu)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Because preemptable RCU does not exist, it never needs the tick.
+ */
+static int rcu_preempt_needs_tick(int cpu)
+{
+	return 0;
+}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 /*
  * Because preemptable RCU does not exist, rcu_barrier() is just
  * another name for rcu_barrier_sched().
@@ -643,3 +664,249 @@ static void __init __rcu_init_preempt(void)
 }
 
 #endif /* #else #ifdef CONFIG_TREE_PREEMPT_RCU */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each CPU in the set, there is a
+ * kthread per RCU flavor ("rcuo" followed by the flavor's letter and
+ * the CPU number) that handles that CPU's callbacks.  Callbacks queued
+ * on such a CPU go onto a lock-free list for the kthread, which waits
+ * for a grace period and then invokes them in process context, so the
+ * CPU itself never runs rcu_do_batch() for them.
+ *
+ * The kthreads are not bound to their CPU: by default they run on the
+ * CPUs whose callbacks are not offloaded, and they may be moved anywhere
+ * with sched_setaffinity().
+ */
+
+static cpumask_var_t rcu_nocb_mask;	/* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;		/* Was rcu_nocb_mask allocated? */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Tell them which CPUs have their callbacks offloaded.  The boot CPU
+ * always keeps its callbacks, so that there is at least one CPU for the
+ * rcuo kthreads to run on.
+ */
+static void __init rcu_bootup_announce_nocb(void)
+{
+	char nocb_buf[64];
+
+#ifdef CONFIG_NO_HZ_FULL
+	/* nohz_full CPUs have no tick to invoke their callbacks from. */
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask) {
+			zalloc_cpumask_var(&rcu_nocb_mask, GFP_NOWAIT);
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (!have_rcu_nocb_mask)
+		return;
+	if (cpumask_test_cpu(smp_processor_id(), rcu_nocb_mask)) {
+		printk(KERN_INFO
+		       "\tOffload of boot CPU %d's callbacks not supported.\n",
+		       smp_processor_id());
+		cpumask_clear_cpu(smp_processor_id(), rcu_nocb_mask);
+	}
+	cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", nocb_buf);
+}
+
+/*
+ * Enqueue the specified callback onto the specified CPU's no-CBs list.
+ * This is lock-free: the tail pointer is swung with xchg() and the
+ * previous tail is then linked up, so the kthread may briefly see a
+ * NULL ->next before the enqueue completes.  Irqs must be disabled.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp)
+{
+	struct rcu_head **old_rhpp;
+
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_inc(&rdp->nocb_q_count);
+
+	/*
+	 * Awaken the kthread only if the list was empty: otherwise it is
+	 * either already awake or will find the callbacks on its next pass.
+	 * If there is no kthread yet, it will find them when it starts.
+	 */
+	if (old_rhpp == &rdp->nocb_head && ACCESS_ONCE(rdp->nocb_kthread))
+		wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * Hand the callback to the CPU's rcuo kthread if the CPU has its
+ * callbacks offloaded.  Returns true if the callback was taken, false
+ * if it should go onto the usual per-CPU lists.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return false;
+	__call_rcu_nocb_enqueue(rdp, rhp);
+	return true;
+}
+
+/*
+ * Wait for a grace period of the kthread's flavor.  The callback used
+ * for this goes onto the usual lists of whichever CPU the kthread is
+ * running on, even if that CPU is itself a no-CBs CPU, since otherwise
+ * two kthreads could end up waiting on each other.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_synchronize rcu;
+
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rdp->nocb_rsp, false);
+	wait_for_completion(&rcu.completion);
+}
+
+/*
+ * Per-rcu_data kthread that invokes the callbacks of a no-CBs CPU.
+ * Each pass grabs everything queued so far, waits for a grace period,
+ * then invokes the callbacks in order, so callback ordering (and thus
+ * rcu_barrier()) is preserved.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_data *rdp = arg;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	long c;
+
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head) != NULL);
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list)
+			continue;
+
+		/* Move the callbacks to a private list, resetting the queue. */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		while (list) {
+			next = list->next;
+			/* Wait for the enqueue to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			local_bh_disable();
+			list->func(list);
+			local_bh_enable();
+			list = next;
+			cond_resched();
+		}
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+	}
+	return 0;
+}
+
+/* Initialize the no-CBs part of a CPU's rcu_data. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp)
+{
+	rdp->nocb_head = NULL;
+	rdp->nocb_tail = &rdp->nocb_head;
+	atomic_long_set(&rdp->nocb_q_count, 0);
+	rdp->nocb_p_count = 0;
+	init_waitqueue_head(&rdp->nocb_wq);
+	rdp->nocb_kthread = NULL;
+	rdp->nocb_rsp = rsp;
+}
+
+/* Create a kthread for each no-CBs CPU of the specified RCU flavor. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp, char abbr,
+					   const struct cpumask *housekeeping)
+{
+	struct task_struct *t;
+	struct rcu_data *rdp;
+	int cpu;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (!cpu_possible(cpu))
+			continue;
+		rdp = rsp->rda[cpu];
+		t = kthread_create(rcu_nocb_kthread, rdp, "rcuo%c/%d", abbr, cpu);
+		BUG_ON(IS_ERR(t));
+		if (!cpumask_empty(housekeeping))
+			set_cpus_allowed_ptr(t, housekeeping);
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+		wake_up_process(t);
+	}
+}
+
+static int __init rcu_init_nocb(void)
+{
+	cpumask_var_t housekeeping;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&housekeeping, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(housekeeping, cpu_possible_mask, rcu_nocb_mask);
+
+	rcu_spawn_nocb_kthreads(&rcu_sched_state, 's', housekeeping);
+	rcu_spawn_nocb_kthreads(&rcu_bh_state, 'b', housekeeping);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state, 'p', housekeeping);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+
+	free_cpumask_var(housekeeping);
+	return 0;
+}
+early_initcall(rcu_init_nocb);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	return false;
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_bootup_announce_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
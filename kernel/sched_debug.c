@@ -241,6 +241,28 @@ void print_rt_rq(struct seq_file *m, int cpu, struct rt_rq *rt_rq)
 #undef P
 }
 
+void print_dl_rq(struct seq_file *m, int cpu, struct dl_rq *dl_rq)
+{
+	SEQ_printf(m, "\ndl_rq[%d]:\n", cpu);
+
+#define P(x) \
+	SEQ_printf(m, "  .%-30s: %Ld\n", #x, (long long)(dl_rq->x))
+#define PN(x) \
+	SEQ_printf(m, "  .%-30s: %Ld.%06ld\n", #x, SPLIT_NS(dl_rq->x))
+
+	P(dl_nr_running);
+#ifdef CONFIG_SMP
+	P(dl_nr_migratory);
+	P(overloaded);
+	PN(earliest_dl);
+#endif
+	SEQ_printf(m, "  .%-30s: %Ld\n", "total_bw",
+		   (long long)def_dl_bw.total_bw);
+
+#undef PN
+#undef P
+}
+
 static void print_cpu(struct seq_file *m, int cpu)
 {
 	struct rq *rq = cpu_rq(cpu);
@@ -300,6 +322,7 @@ static void print_cpu(struct seq_file *m, int cpu)
 #endif
 	print_cfs_stats(m, cpu);
 	print_rt_stats(m, cpu);
+	print_dl_stats(m, cpu);
 
 	print_rq(m, rq, cpu);
 }
@@ -458,6 +481,14 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 	P(se.load.weight);
 	P(policy);
 	P(prio);
+	if (task_has_dl_policy(p)) {
+		PN(dl.dl_runtime);
+		PN(dl.dl_deadline);
+		PN(dl.dl_period);
+		PN(dl.runtime);
+		PN(dl.deadline);
+		P(dl.dl_throttled);
+	}
 #undef PN
 #undef __PN
 #undef P
@@ -276,6 +276,52 @@ sched_info_switch(struct task_struct *prev, struct task_struct *next)
 #define sched_info_switch(t, next)		do { } while (0)
 #endif /* CONFIG_SCHEDSTATS || CONFIG_TASK_DELAY_ACCT */
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * Latency histograms: a task is stamped with the rq clock whenever it
+ * becomes runnable, and the time until it is switched in is accounted
+ * as runqueue wait and, if it got there through a wakeup, as wakeup
+ * latency. Both go to the per-cpu histograms and to those of the
+ * task's group. Called with the rq lock held.
+ */
+static inline void
+latency_hist_queued(struct rq *rq, struct task_struct *t, int wakeup)
+{
+	t->hist_queued = rq->clock ? : 1;
+	t->hist_woken = wakeup;
+}
+
+static inline void
+latency_hist_switch(struct rq *rq, struct task_struct *prev,
+		    struct task_struct *next)
+{
+	u64 delta;
+
+	/* preempted, still runnable */
+	if (prev->se.on_rq)
+		latency_hist_queued(rq, prev, 0);
+
+	if (!next->hist_queued)
+		return;
+
+	delta = rq->clock - next->hist_queued;
+	if ((s64)delta < 0)
+		delta = 0;
+	next->hist_queued = 0;
+
+	if (!latency_hist_enabled)
+		return;
+
+	latency_hist_record(LATENCY_HIST_RQWAIT, delta);
+	if (next->hist_woken)
+		latency_hist_record(LATENCY_HIST_WAKEUP, delta);
+	tg_latency_hist_account(rq, next, delta);
+}
+#else
+#define latency_hist_queued(rq, t, wakeup)	do { } while (0)
+#define latency_hist_switch(rq, t, next)	do { } while (0)
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
 /*
  * The following are functions that support scheduler-internal time accounting.
  * These functions are generally called at the timer tick.  None of this depends
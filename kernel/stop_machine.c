@@ -2,6 +2,7 @@
  * GPL v2 and any later version.
  */
 #include <linux/cpu.h>
+#include <linux/completion.h>
 #include <linux/err.h>
 #include <linux/kthread.h>
 #include <linux/module.h>
@@ -38,14 +39,18 @@ struct stop_machine_data {
 static unsigned int num_threads;
 static atomic_t thread_ack;
 static DEFINE_MUTEX(lock);
-/* setup_lock protects refcount, stop_machine_wq and stop_machine_work. */
-static DEFINE_MUTEX(setup_lock);
-/* Users of stop_machine. */
-static int refcount;
-static struct workqueue_struct *stop_machine_wq;
 static struct stop_machine_data active, idle;
 static const struct cpumask *active_cpus;
-static void *stop_machine_work;
+
+/*
+ * One RT thread per cpu runs stop_cpu().  Workqueues can't be used for
+ * this: their shared workers don't guarantee that a work item runs on
+ * the cpu it was queued on while that cpu is being taken down.
+ */
+static DEFINE_PER_CPU(struct task_struct *, stopper_task);
+static DEFINE_PER_CPU(int, stopper_pending);
+static atomic_t stoppers_left;
+static struct completion stoppers_done;
 
 static void set_state(enum stopmachine_state newstate)
 {
@@ -63,8 +68,8 @@ static void ack_state(void)
 }
 
 /* This is the actual function which stops the CPU. It runs
- * in the context of a dedicated stopmachine workqueue. */
-static void stop_cpu(struct work_struct *unused)
+ * in the context of the cpu's stopper thread. */
+static void stop_cpu(void)
 {
 	enum stopmachine_state curstate = STOPMACHINE_NONE;
 	struct stop_machine_data *smdata = &idle;
@@ -112,46 +117,90 @@ static int chill(void *unused)
 	return 0;
 }
 
-int stop_machine_create(void)
+static int stopper_thread(void *data)
+{
+	unsigned int cpu = (unsigned long)data;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!per_cpu(stopper_pending, cpu)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		per_cpu(stopper_pending, cpu) = 0;
+		stop_cpu();
+		if (atomic_dec_and_test(&stoppers_left))
+			complete(&stoppers_done);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __cpuinit stopper_cpu_callback(struct notifier_block *nfb,
+					  unsigned long action, void *hcpu)
 {
-	mutex_lock(&setup_lock);
-	if (refcount)
-		goto done;
-	stop_machine_wq = create_rt_workqueue("kstop");
-	if (!stop_machine_wq)
-		goto err_out;
-	stop_machine_work = alloc_percpu(struct work_struct);
-	if (!stop_machine_work)
-		goto err_out;
-done:
-	refcount++;
-	mutex_unlock(&setup_lock);
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	unsigned int cpu = (unsigned long)hcpu;
+	struct task_struct *p;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_UP_PREPARE:
+		p = kthread_create(stopper_thread, hcpu, "kstop/%u", cpu);
+		if (IS_ERR(p))
+			return NOTIFY_BAD;
+		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
+		per_cpu(stopper_task, cpu) = p;
+		break;
+
+	case CPU_ONLINE:
+		p = per_cpu(stopper_task, cpu);
+		kthread_bind(p, cpu);
+		wake_up_process(p);
+		break;
+
+	case CPU_UP_CANCELED:
+	case CPU_POST_DEAD:
+		/* the thread has been moved off the dead cpu by now */
+		kthread_stop(per_cpu(stopper_task, cpu));
+		per_cpu(stopper_task, cpu) = NULL;
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init stop_machine_init(void)
+{
+	void *bcpu = (void *)(long)smp_processor_id();
+
+	/* the boot cpu is already up, the rest comes via the notifier */
+	BUG_ON(stopper_cpu_callback(NULL, CPU_UP_PREPARE, bcpu) != NOTIFY_OK);
+	stopper_cpu_callback(NULL, CPU_ONLINE, bcpu);
+	hotcpu_notifier(stopper_cpu_callback, 0);
 	return 0;
+}
+early_initcall(stop_machine_init);
 
-err_out:
-	if (stop_machine_wq)
-		destroy_workqueue(stop_machine_wq);
-	mutex_unlock(&setup_lock);
-	return -ENOMEM;
+/*
+ * The stopper threads are always around, these are kept for the users
+ * which want to make sure stop_machine() can't fail for lack of them.
+ */
+int stop_machine_create(void)
+{
+	return 0;
 }
 EXPORT_SYMBOL_GPL(stop_machine_create);
 
 void stop_machine_destroy(void)
 {
-	mutex_lock(&setup_lock);
-	refcount--;
-	if (refcount)
-		goto done;
-	destroy_workqueue(stop_machine_wq);
-	free_percpu(stop_machine_work);
-done:
-	mutex_unlock(&setup_lock);
 }
 EXPORT_SYMBOL_GPL(stop_machine_destroy);
 
 int __stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus)
 {
-	struct work_struct *sm_work;
 	int i, ret;
 
 	/* Set up initial state. */
@@ -165,18 +214,19 @@ int __stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus)
 	idle.data = NULL;
 
 	set_state(STOPMACHINE_PREPARE);
+	atomic_set(&stoppers_left, num_threads);
+	init_completion(&stoppers_done);
 
-	/* Schedule the stop_cpu work on all cpus: hold this CPU so one
+	/* Kick the stopper threads on all cpus: hold this CPU so one
 	 * doesn't hit this CPU until we're ready. */
 	get_cpu();
 	for_each_online_cpu(i) {
-		sm_work = per_cpu_ptr(stop_machine_work, i);
-		INIT_WORK(sm_work, stop_cpu);
-		queue_work_on(i, stop_machine_wq, sm_work);
+		per_cpu(stopper_pending, i) = 1;
+		wake_up_process(per_cpu(stopper_task, i));
 	}
 	/* This will release the thread on our CPU. */
 	put_cpu();
-	flush_workqueue(stop_machine_wq);
+	wait_for_completion(&stoppers_done);
 	ret = active.fnret;
 	mutex_unlock(&lock);
 	return ret;
@@ -132,6 +132,8 @@ cond_syscall(sys_io_destroy);
 cond_syscall(sys_io_submit);
 cond_syscall(sys_io_cancel);
 cond_syscall(sys_io_getevents);
+cond_syscall(sys_io_setup_sq);
+cond_syscall(sys_io_sq_enter);
 cond_syscall(sys_syslog);
 
 /* arch-specific weak syscall entries */
@@ -158,6 +160,10 @@ cond_syscall(sys_mremap);
 cond_syscall(sys_remap_file_pages);
 cond_syscall(compat_sys_move_pages);
 cond_syscall(compat_sys_migrate_pages);
+cond_syscall(sys_process_vm_readv);
+cond_syscall(sys_process_vm_writev);
+cond_syscall(compat_sys_process_vm_readv);
+cond_syscall(compat_sys_process_vm_writev);
 
 /* block-layer dependent */
 cond_syscall(sys_bdflush);
@@ -21,6 +21,9 @@
 #include <linux/sched.h>
 #include <linux/tick.h>
 #include <linux/module.h>
+#include <linux/bootmem.h>
+#include <linux/posix-timers.h>
+#include <linux/smp.h>
 
 #include <asm/irq_regs.h>
 
@@ -195,6 +198,24 @@ u64 get_cpu_idle_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_idle_time_us);
 
+#ifdef CONFIG_NO_HZ_FULL
+static void tick_nohz_full_restart_tick(struct tick_sched *ts);
+
+/*
+ * nohz_full CPUs rely on housekeeping CPUs for timekeeping, so the CPU
+ * holding (or about to pick up) the do_timer duty keeps its tick even
+ * when idle.
+ */
+static inline bool tick_nohz_keep_timekeeper(int cpu)
+{
+	return tick_nohz_full_running &&
+	       (cpu == tick_do_timer_cpu ||
+		tick_do_timer_cpu == TICK_DO_TIMER_NONE);
+}
+#else
+static inline bool tick_nohz_keep_timekeeper(int cpu) { return false; }
+#endif
+
 /**
  * tick_nohz_stop_sched_tick - stop the idle tick from the idle task
  *
@@ -224,6 +245,12 @@ void tick_nohz_stop_sched_tick(int inidle)
 	if (!inidle && !ts->inidle)
 		goto end;
 
+#ifdef CONFIG_NO_HZ_FULL
+	/* Entering idle with the busy tick stopped: take it back first */
+	if (!ts->inidle && ts->tick_stopped)
+		tick_nohz_full_restart_tick(ts);
+#endif
+
 	/*
 	 * Set ts->inidle unconditionally. Even if the system did not
 	 * switch to NOHZ mode the cpu frequency governers rely on the
@@ -282,7 +309,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	} while (read_seqretry(&xtime_lock, seq));
 
 	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
-	    arch_needs_cpu(cpu)) {
+	    arch_needs_cpu(cpu) || tick_nohz_keep_timekeeper(cpu)) {
 		next_jiffies = last_jiffies + 1;
 		delta_jiffies = 1;
 	} else {
@@ -502,6 +529,251 @@ void tick_nohz_restart_sched_tick(void)
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Full dynticks: on the CPUs listed in nohz_full= the tick is also
+ * stopped while a single task is runnable, as long as nothing needs the
+ * tick to make progress. These CPUs never keep the do_timer duty, so
+ * timekeeping is left to the housekeeping CPUs.
+ */
+bool tick_nohz_full_running;
+cpumask_var_t tick_nohz_full_mask;
+
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING
+		       "NOHZ: Clearing %d from nohz_full range for timekeeping\n",
+		       cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+static bool can_stop_full_tick(struct tick_sched *ts, int cpu)
+{
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return false;
+
+	if (need_resched() || local_softirq_pending())
+		return false;
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (rcu_needs_tick(cpu) || printk_needs_cpu(cpu) ||
+	    arch_needs_cpu(cpu))
+		return false;
+
+	return true;
+}
+
+/*
+ * Account the ticks that were not delivered while the tick was
+ * stopped. Without context tracking we cannot tell how the time was
+ * split between user and kernel mode, so it is charged according to
+ * the context the CPU is leaving now: the interrupted mode when called
+ * from irq_exit(), system time otherwise. The scheduler scales utime
+ * and stime to the precise sum_exec_runtime when reporting them.
+ */
+static void tick_nohz_full_account(struct tick_sched *ts)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	struct pt_regs *regs = get_irq_regs();
+	unsigned long ticks = jiffies - ts->idle_jiffies;
+	cputime_t delta;
+
+	/* We might be one off. Do not account a huge number of ticks! */
+	if (!ticks || ticks >= LONG_MAX)
+		return;
+
+	delta = jiffies_to_cputime(ticks);
+	if (regs && user_mode(regs))
+		account_user_time(current, delta, delta);
+	else
+		account_system_time(current, 0, delta, delta);
+	ts->idle_jiffies += ticks;
+#endif
+}
+
+static void tick_nohz_full_stop_tick(struct tick_sched *ts, int cpu)
+{
+	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
+	ktime_t last_update, expires;
+
+	/* Hand timekeeping over to a housekeeping CPU */
+	if (cpu == tick_do_timer_cpu)
+		tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	next_jiffies = get_next_timer_interrupt(last_jiffies);
+	delta_jiffies = next_jiffies - last_jiffies;
+
+	/* Not worth it if the next timer is only one tick away */
+	if (!ts->tick_stopped && (long)delta_jiffies <= 1)
+		return;
+
+	if ((long)delta_jiffies < 1)
+		delta_jiffies = 1;
+
+	if (likely(delta_jiffies < NEXT_TIMER_MAX_DELTA))
+		expires = ktime_add_ns(last_update,
+				       tick_period.tv64 * delta_jiffies);
+	else
+		expires.tv64 = KTIME_MAX;
+
+	if (!ts->tick_stopped) {
+		ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
+		ts->idle_jiffies = last_jiffies;
+		ts->tick_stopped = 1;
+	} else {
+		tick_nohz_full_account(ts);
+	}
+
+	ts->next_jiffies = next_jiffies;
+	ts->last_jiffies = last_jiffies;
+
+	if (unlikely(expires.tv64 == KTIME_MAX)) {
+		if (ts->nohz_mode == NOHZ_MODE_HIGHRES)
+			hrtimer_cancel(&ts->sched_timer);
+		return;
+	}
+
+	if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
+		hrtimer_start(&ts->sched_timer, expires,
+			      HRTIMER_MODE_ABS_PINNED);
+		if (hrtimer_active(&ts->sched_timer))
+			return;
+	} else if (!tick_program_event(expires, 0))
+		return;
+
+	/* Already past the event: let the tick handle the timer wheel */
+	tick_do_update_jiffies64(ktime_get());
+	raise_softirq_irqoff(TIMER_SOFTIRQ);
+}
+
+static void tick_nohz_full_restart_tick(struct tick_sched *ts)
+{
+	ktime_t now = ktime_get();
+
+	tick_do_update_jiffies64(now);
+	tick_nohz_full_account(ts);
+	touch_softlockup_watchdog();
+	ts->tick_stopped = 0;
+	tick_nohz_restart(ts, now);
+}
+
+/**
+ * __tick_nohz_full_check - stop or restart the tick on a nohz_full CPU
+ *
+ * Called on the way out of interrupts and after a context switch,
+ * i.e. whenever the answer to "does this CPU still need its tick?" may
+ * have changed. The idle loop is left to tick_nohz_stop_sched_tick().
+ */
+void __tick_nohz_full_check(void)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+	int cpu;
+
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+	if (!cpumask_test_cpu(cpu, tick_nohz_full_mask))
+		goto out;
+
+	ts = &per_cpu(tick_cpu_sched, cpu);
+	if (ts->inidle)
+		goto out;
+
+	if (can_stop_full_tick(ts, cpu))
+		tick_nohz_full_stop_tick(ts, cpu);
+	else if (ts->tick_stopped)
+		tick_nohz_full_restart_tick(ts);
+out:
+	local_irq_restore(flags);
+}
+
+static DEFINE_PER_CPU(struct call_single_data, nohz_full_kick_csd);
+static DEFINE_PER_CPU(unsigned long, nohz_full_kick_pending);
+
+static void nohz_full_kick_func(void *info)
+{
+	/* irq_exit() does the actual re-evaluation */
+	clear_bit(0, &__get_cpu_var(nohz_full_kick_pending));
+}
+
+/**
+ * tick_nohz_full_kick_cpu - make a nohz_full CPU re-evaluate its tick
+ * @cpu:	the CPU to kick
+ *
+ * Used when some other CPU needs work done that only the tick of @cpu
+ * performs, such as reporting an RCU quiescent state. May be called
+ * with interrupts disabled.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	struct call_single_data *csd;
+
+	if (!tick_nohz_full_cpu(cpu) || cpu == smp_processor_id())
+		return;
+
+	if (test_and_set_bit(0, &per_cpu(nohz_full_kick_pending, cpu)))
+		return;
+
+	csd = &per_cpu(nohz_full_kick_csd, cpu);
+	csd->func = nohz_full_kick_func;
+	csd->info = NULL;
+	csd->flags = 0;
+	__smp_call_function_single(cpu, csd, 0);
+}
+
+/**
+ * tick_nohz_full_kick_timer - a timer was queued for a nohz_full CPU
+ * @cpu:	the CPU whose tick has to run the timer
+ *
+ * A stopped tick was programmed for the timers known at the time, or
+ * not at all, so a new timer_list timer on @cpu or a CPU timer of a task
+ * running there would be delayed indefinitely.  Make @cpu re-evaluate
+ * its tick.  May be called with interrupts disabled and with the timer
+ * wheel lock held.
+ */
+void tick_nohz_full_kick_timer(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (cpu != smp_processor_id()) {
+		tick_nohz_full_kick_cpu(cpu);
+		return;
+	}
+
+	/*
+	 * Locally, irq_exit() re-evaluates the tick when we are in an
+	 * interrupt.  Otherwise force a pass through schedule(), which
+	 * does it on the way back to user space.
+	 */
+	if (per_cpu(tick_cpu_sched, cpu).tick_stopped && !in_interrupt())
+		set_tsk_need_resched(current);
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -527,7 +799,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -682,7 +955,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -76,6 +76,7 @@ struct tvec_base {
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
+	int cpu;
 	struct tvec_root tv1;
 	struct tvec tv2;
 	struct tvec tv3;
@@ -693,6 +694,12 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	    !tbase_get_deferrable(timer->base))
 		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
+	/*
+	 * A nohz_full CPU with its tick stopped has to notice the new
+	 * timer; deferrable timers may wait for the next tick anyway.
+	 */
+	if (!tbase_get_deferrable(timer->base))
+		tick_nohz_full_kick_timer(base->cpu);
 
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
@@ -823,6 +830,8 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * the timer wheel.
 	 */
 	wake_up_idle_cpu(cpu);
+	if (!tbase_get_deferrable(timer->base))
+		tick_nohz_full_kick_timer(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -1554,6 +1563,7 @@ static int __cpuinit init_timers_cpu(int cpu)
 			base = &boot_tvec_bases;
 		}
 		spin_lock_init(&base->lock);
+		base->cpu = cpu;
 		tvec_base_done[cpu] = 1;
 	} else {
 		base = per_cpu(tvec_bases, cpu);
@@ -80,9 +80,9 @@
  *  ->i_mutex
  *    ->i_alloc_sem             (various)
  *
- *  ->inode_lock
+ *  ->inode_wb_list_lock
  *    ->sb_lock			(fs/fs-writeback.c)
- *    ->mapping->tree_lock	(__sync_single_inode)
+ *    ->inode->i_lock		(writeback_single_inode)
  *
  *  ->i_mmap_lock
  *    ->anon_vma.lock		(vma_adjust)
@@ -98,8 +98,8 @@
  *    ->zone.lru_lock		(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->tree_lock		(page_remove_rmap->set_page_dirty)
- *    ->inode_lock		(page_remove_rmap->set_page_dirty)
- *    ->inode_lock		(zap_pte_range->set_page_dirty)
+ *    ->inode->i_lock		(page_remove_rmap->set_page_dirty)
+ *    ->inode->i_lock		(zap_pte_range->set_page_dirty)
  *    ->private_lock		(zap_pte_range->__set_page_dirty_buffers)
  *
  *  ->task->proc_lock
@@ -479,6 +479,111 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+static int add_to_page_cache_lru_each(struct page **pages, int nr_pages,
+		struct address_space *mapping, gfp_t gfp_mask)
+{
+	int i, nr_added = 0;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+
+		if (add_to_page_cache_lru(page, mapping, page->index, gfp_mask)) {
+			page_cache_release(page);
+			pages[i] = NULL;
+		} else
+			nr_added++;
+	}
+	return nr_added;
+}
+
+/**
+ * add_to_page_cache_lru_batch - add a batch of new pages to the pagecache
+ * @pages:	array of new pages, their ->index already set
+ * @nr_pages:	number of entries in @pages, at most PAGEVEC_SIZE
+ * @mapping:	the address_space the pages belong to
+ * @gfp_mask:	page allocation mode
+ *
+ * Does add_to_page_cache_lru() for each page in @pages, but charges the
+ * memory controller once for the whole batch and inserts all the pages
+ * into the radix tree under a single hold of the tree_lock. This is meant
+ * for readahead, where the per-page locking shows up with fast devices.
+ *
+ * Pages that were added are locked and left in @pages, still holding the
+ * caller's reference. Pages that could not be added (typically because
+ * someone else instantiated that index in the meantime) are released and
+ * their slot in @pages is cleared.
+ *
+ * Returns the number of pages added.
+ */
+int add_to_page_cache_lru_batch(struct page **pages, int nr_pages,
+		struct address_space *mapping, gfp_t gfp_mask)
+{
+	int i, error, nr_added = 0;
+
+	VM_BUG_ON(nr_pages > PAGEVEC_SIZE);
+
+	/* shmem/tmpfs pages need the per-page SwapBacked handling */
+	if (mapping_cap_swap_backed(mapping))
+		return add_to_page_cache_lru_each(pages, nr_pages,
+						  mapping, gfp_mask);
+
+	if (mem_cgroup_cache_charge_batch(pages, nr_pages, current->mm,
+					  gfp_mask & GFP_RECLAIM_MASK))
+		return add_to_page_cache_lru_each(pages, nr_pages,
+						  mapping, gfp_mask);
+
+	error = radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
+	if (error) {
+		for (i = 0; i < nr_pages; i++) {
+			mem_cgroup_uncharge_cache_page(pages[i]);
+			page_cache_release(pages[i]);
+			pages[i] = NULL;
+		}
+		return 0;
+	}
+
+	/*
+	 * The preload only guarantees the nodes for one insertion, further
+	 * nodes come from GFP_ATOMIC allocations (the page_tree's gfp mask).
+	 * Should one of those fail, only the affected pages are skipped.
+	 */
+	spin_lock_irq(&mapping->tree_lock);
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+
+		__set_page_locked(page);
+		page_cache_get(page);
+		page->mapping = mapping;
+		error = radix_tree_insert(&mapping->page_tree,
+					  page->index, page);
+		if (likely(!error)) {
+			mapping->nrpages++;
+			__inc_zone_page_state(page, NR_FILE_PAGES);
+			nr_added++;
+		} else
+			page->mapping = NULL;
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+	radix_tree_preload_end();
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+
+		if (likely(page->mapping)) {
+			lru_cache_add_file(page);
+			continue;
+		}
+		__clear_page_locked(page);
+		mem_cgroup_uncharge_cache_page(page);
+		/* the pagecache reference taken above, then the caller's */
+		page_cache_release(page);
+		page_cache_release(page);
+		pages[i] = NULL;
+	}
+	return nr_added;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_batch);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -612,6 +717,66 @@ int __lock_page_killable(struct page *page)
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
+/*
+ * Asynchronous kiocbs do not sleep on a locked page: they are queued on
+ * the page wait queue and kicked when the page gets unlocked.
+ */
+static int kiocb_page_wake_function(wait_queue_t *wait, unsigned mode,
+				    int sync, void *arg)
+{
+	struct wait_bit_key *key = arg;
+	struct kiocb *iocb = io_wait_to_kiocb(wait);
+
+	if (iocb->ki_wait_key.flags != key->flags ||
+	    iocb->ki_wait_key.bit_nr != key->bit_nr)
+		return 0;
+	list_del_init(&wait->task_list);
+	kick_iocb(iocb);
+	return 1;
+}
+
+/**
+ * lock_page_async - get a lock on the page on behalf of an async kiocb
+ * @page: the page to lock
+ * @iocb: the kiocb
+ *
+ * Returns 0 with the page locked, or -EIOCBRETRY if it is locked by
+ * somebody else, in which case @iocb is kicked once it gets unlocked.
+ */
+static int lock_page_async(struct page *page, struct kiocb *iocb)
+{
+	wait_queue_head_t *q = page_waitqueue(page);
+	wait_queue_t *wait = &iocb->ki_wait;
+	unsigned long flags;
+	int queued;
+
+	/* still waiting for the page a previous pass stopped at */
+	if (!list_empty_careful(&wait->task_list))
+		return -EIOCBRETRY;
+
+	while (!trylock_page(page)) {
+		iocb->ki_wait_key.flags = &page->flags;
+		iocb->ki_wait_key.bit_nr = PG_locked;
+		wait->func = kiocb_page_wake_function;
+		add_wait_queue(q, wait);
+
+		/* pairs with smp_mb__after_clear_bit() in unlock_page() */
+		smp_mb();
+		if (PageLocked(page))
+			return -EIOCBRETRY;
+
+		/* unlocked meanwhile: dequeue, unless the wakeup beat us */
+		spin_lock_irqsave(&q->lock, flags);
+		queued = !list_empty(&wait->task_list);
+		if (queued)
+			list_del_init(&wait->task_list);
+		spin_unlock_irqrestore(&q->lock, flags);
+		if (!queued)
+			return -EIOCBRETRY;
+	}
+	return 0;
+}
+
 /**
  * __lock_page_nosync - get a lock on the page, without calling sync_page()
  * @page: the page to lock
@@ -982,9 +1147,14 @@ static void shrink_readahead_size_eio(struct file *filp,
  *
  * This is really ugly. But the goto's actually try to clarify some
  * of the logic when it comes to error handling etc.
+ *
+ * If @iocb is an asynchronous kiocb, waits for pages under I/O are not
+ * done in place: the read stops with -EIOCBRETRY and @iocb gets kicked
+ * when the page is unlocked.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		struct kiocb *iocb)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1104,7 +1274,10 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		if (iocb)
+			error = lock_page_async(page, iocb);
+		else
+			error = lock_page_killable(page);
 		if (unlikely(error))
 			goto readpage_error;
 
@@ -1141,7 +1314,10 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			error = lock_page_killable(page);
+			if (iocb)
+				error = lock_page_async(page, iocb);
+			else
+				error = lock_page_killable(page);
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
@@ -1338,7 +1514,8 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		do_generic_file_read(filp, ppos, &desc, file_read_actor,
+				     is_sync_kiocb(iocb) ? NULL : iocb);
 		retval += desc.written;
 		if (desc.error) {
 			retval = retval ?: desc.error;
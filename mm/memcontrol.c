@@ -38,6 +38,7 @@
 #include <linux/vmalloc.h>
 #include <linux/mm_inline.h>
 #include <linux/page_cgroup.h>
+#include <linux/vmpressure.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -225,6 +226,9 @@ struct mem_cgroup {
 	/* set when res.limit == memsw.limit */
 	bool		memsw_is_minimum;
 
+	/* reclaim pressure notification */
+	struct vmpressure vmpressure;
+
 	/*
 	 * statistics. This must be placed at the end of memcg.
 	 */
@@ -274,7 +278,6 @@ enum charge_type {
 
 static void mem_cgroup_get(struct mem_cgroup *mem);
 static void mem_cgroup_put(struct mem_cgroup *mem);
-static struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *mem);
 
 static struct mem_cgroup_per_zone *
 mem_cgroup_zoneinfo(struct mem_cgroup *mem, int nid, int zid)
@@ -535,6 +538,29 @@ static struct mem_cgroup *mem_cgroup_from_cont(struct cgroup *cont)
 				css);
 }
 
+/*
+ * Global reclaim (memcg == NULL) is accounted to the root group, which
+ * may not exist yet during early boot.
+ */
+struct vmpressure *memcg_to_vmpressure(struct mem_cgroup *mem)
+{
+	if (!mem)
+		mem = root_mem_cgroup;
+	if (!mem)
+		return NULL;
+	return &mem->vmpressure;
+}
+
+struct mem_cgroup *vmpressure_to_memcg(struct vmpressure *vmpr)
+{
+	return container_of(vmpr, struct mem_cgroup, vmpressure);
+}
+
+struct vmpressure *cg_to_vmpressure(struct cgroup *cg)
+{
+	return &mem_cgroup_from_cont(cg)->vmpressure;
+}
+
 struct mem_cgroup *mem_cgroup_from_task(struct task_struct *p)
 {
 	/*
@@ -970,6 +996,20 @@ static bool mem_cgroup_check_under_limit(struct mem_cgroup *mem)
 	return false;
 }
 
+/*
+ * Returns how many bytes can still be charged to @mem before one of its
+ * counters hits its limit.
+ */
+static unsigned long long mem_cgroup_margin(struct mem_cgroup *mem)
+{
+	unsigned long long margin;
+
+	margin = res_counter_margin(&mem->res);
+	if (do_swap_account)
+		margin = min(margin, res_counter_margin(&mem->memsw));
+	return margin;
+}
+
 static unsigned int get_swappiness(struct mem_cgroup *memcg)
 {
 	struct cgroup *cgrp = memcg->css.cgroup;
@@ -1266,15 +1306,17 @@ done:
 
 /*
  * Unlike exported interface, "oom" parameter is added. if oom==true,
- * oom-killer can be invoked.
+ * oom-killer can be invoked. @nr_pages pages are charged at once, but
+ * only one css reference is taken for them.
  */
 static int __mem_cgroup_try_charge(struct mm_struct *mm,
 			gfp_t gfp_mask, struct mem_cgroup **memcg,
-			bool oom, struct page *page)
+			bool oom, struct page *page, int nr_pages)
 {
 	struct mem_cgroup *mem, *mem_over_limit;
 	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct res_counter *fail_res;
+	unsigned long csize = nr_pages * PAGE_SIZE;
 
 	if (unlikely(test_thread_flag(TIF_MEMDIE))) {
 		/* Don't account this! */
@@ -1306,16 +1348,15 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 
 		if (mem_cgroup_is_root(mem))
 			goto done;
-		ret = res_counter_charge(&mem->res, PAGE_SIZE, &fail_res);
+		ret = res_counter_charge(&mem->res, csize, &fail_res);
 		if (likely(!ret)) {
 			if (!do_swap_account)
 				break;
-			ret = res_counter_charge(&mem->memsw, PAGE_SIZE,
-							&fail_res);
+			ret = res_counter_charge(&mem->memsw, csize, &fail_res);
 			if (likely(!ret))
 				break;
 			/* mem+swap counter fails */
-			res_counter_uncharge(&mem->res, PAGE_SIZE);
+			res_counter_uncharge(&mem->res, csize);
 			flags |= MEM_CGROUP_RECLAIM_NOSWAP;
 			mem_over_limit = mem_cgroup_from_res_counter(fail_res,
 									memsw);
@@ -1329,6 +1370,21 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 
 		ret = mem_cgroup_hierarchical_reclaim(mem_over_limit, NULL,
 						gfp_mask, flags);
+
+		/*
+		 * Reclaim succeeding or the group being under its limit only
+		 * means there is room for a single page.  A batch is retried
+		 * only while there is room for all of it, and a bounded
+		 * number of times; the caller falls back to charging one
+		 * page at a time.
+		 */
+		if (nr_pages > 1) {
+			if (!nr_retries-- ||
+			    mem_cgroup_margin(mem_over_limit) < csize)
+				goto nomem;
+			continue;
+		}
+
 		if (ret)
 			continue;
 
@@ -1574,7 +1630,8 @@ static int mem_cgroup_move_parent(struct page_cgroup *pc,
 	parent = mem_cgroup_from_cont(pcg);
 
 
-	ret = __mem_cgroup_try_charge(NULL, gfp_mask, &parent, false, page);
+	ret = __mem_cgroup_try_charge(NULL, gfp_mask, &parent, false,
+				      page, 1);
 	if (ret || !parent)
 		return ret;
 
@@ -1633,7 +1690,7 @@ static int mem_cgroup_charge_common(struct page *page, struct mm_struct *mm,
 	prefetchw(pc);
 
 	mem = memcg;
-	ret = __mem_cgroup_try_charge(mm, gfp_mask, &mem, true, page);
+	ret = __mem_cgroup_try_charge(mm, gfp_mask, &mem, true, page, 1);
 	if (ret || !mem)
 		return ret;
 
@@ -1723,6 +1780,46 @@ int mem_cgroup_cache_charge(struct page *page, struct mm_struct *mm,
 	return ret;
 }
 
+/*
+ * Charge a batch of new file cache pages, as used by readahead. The
+ * res_counters are charged once for the whole batch and each page_cgroup
+ * is committed afterwards. Returns 0 if all the pages were charged, or
+ * -ENOMEM with none of them charged; the OOM killer is never invoked, the
+ * caller is expected to fall back to mem_cgroup_cache_charge() per page.
+ */
+int mem_cgroup_cache_charge_batch(struct page **pages, int nr_pages,
+				  struct mm_struct *mm, gfp_t gfp_mask)
+{
+	struct mem_cgroup *mem = NULL;
+	struct page_cgroup *pc;
+	int i, ret;
+
+	if (mem_cgroup_disabled())
+		return 0;
+	if (unlikely(!mm))
+		mm = &init_mm;
+
+	ret = __mem_cgroup_try_charge(mm, gfp_mask, &mem, false,
+				      pages[0], nr_pages);
+	if (ret || !mem)
+		return ret;
+
+	for (i = 0; i < nr_pages; i++) {
+		VM_BUG_ON(!page_is_file_cache(pages[i]));
+		/* try_charge() took one reference, every page needs one */
+		if (i)
+			css_get(&mem->css);
+		pc = lookup_page_cgroup(pages[i]);
+		if (unlikely(!pc)) {
+			mem_cgroup_cancel_charge_swapin(mem);
+			continue;
+		}
+		__mem_cgroup_commit_charge(mem, pc,
+					   MEM_CGROUP_CHARGE_TYPE_CACHE);
+	}
+	return 0;
+}
+
 /*
  * While swap-in, try_charge -> commit or cancel, the page is locked.
  * And when try_charge() successfully returns, one refcnt to memcg without
@@ -1752,14 +1849,14 @@ int mem_cgroup_try_charge_swapin(struct mm_struct *mm,
 	if (!mem)
 		goto charge_cur_mm;
 	*ptr = mem;
-	ret = __mem_cgroup_try_charge(NULL, mask, ptr, true, page);
+	ret = __mem_cgroup_try_charge(NULL, mask, ptr, true, page, 1);
 	/* drop extra refcnt from tryget */
 	css_put(&mem->css);
 	return ret;
 charge_cur_mm:
 	if (unlikely(!mm))
 		mm = &init_mm;
-	return __mem_cgroup_try_charge(mm, mask, ptr, true, page);
+	return __mem_cgroup_try_charge(mm, mask, ptr, true, page, 1);
 }
 
 static void
@@ -2011,7 +2108,7 @@ int mem_cgroup_prepare_migration(struct page *page, struct mem_cgroup **ptr)
 	*ptr = mem;
 	if (mem) {
 		ret = __mem_cgroup_try_charge(NULL, GFP_KERNEL, ptr, false,
-						page);
+						page, 1);
 		css_put(&mem->css);
 	}
 	return ret;
@@ -2892,6 +2989,11 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "pressure_level",
+		.register_event = vmpressure_register_event,
+		.unregister_event = vmpressure_unregister_event,
+	},
 };
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_SWAP
@@ -3040,7 +3142,7 @@ static void mem_cgroup_put(struct mem_cgroup *mem)
 /*
  * Returns the parent mem_cgroup in memcgroup hierarchy with hierarchy enabled.
  */
-static struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *mem)
+struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *mem)
 {
 	if (!mem->res.parent)
 		return NULL;
@@ -3128,6 +3230,7 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	}
 	mem->last_scanned_child = 0;
 	spin_lock_init(&mem->reclaim_param_lock);
+	vmpressure_init(&mem->vmpressure);
 
 	if (parent)
 		mem->swappiness = get_swappiness(parent);
@@ -3152,6 +3255,7 @@ static void mem_cgroup_destroy(struct cgroup_subsys *ss,
 {
 	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
 
+	vmpressure_cleanup(&mem->vmpressure);
 	mem_cgroup_put(mem);
 }
 
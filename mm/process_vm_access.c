@@ -0,0 +1,448 @@
+/*
+ *	linux/mm/process_vm_access.c
+ *
+ * Copy data directly between the address spaces of two processes.
+ *
+ * process_vm_readv() and process_vm_writev() transfer data between an
+ * iovec in the calling process and an iovec describing memory in a
+ * target process, without going through an intermediate buffer or a
+ * pipe.  The target pages are pinned with get_user_pages() and copied
+ * to or from the local buffers with copy_{to,from}_user(), so each byte
+ * is moved exactly once.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/ptrace.h>
+#include <linux/slab.h>
+#include <linux/syscalls.h>
+
+#ifdef CONFIG_COMPAT
+#include <linux/compat.h>
+#endif
+
+#include <asm/uaccess.h>
+
+/*
+ * Upper bound on the number of remote pages pinned at once.  The page
+ * array lives on the stack for small transfers and is kmalloc'ed up to
+ * one page otherwise.
+ */
+#define PVM_MAX_KMALLOC_PAGES	(PAGE_SIZE / sizeof(struct page *))
+#define PVM_MAX_PP_ARRAY_COUNT	16
+
+/*
+ * Cursor into the local iovec array.  Zero length segments are skipped
+ * lazily so that callers may pass sparse vectors.
+ */
+struct pvm_iter {
+	const struct iovec	*iov;
+	unsigned long		nr_segs;
+	unsigned long		seg;
+	size_t			offset;
+};
+
+/**
+ * process_vm_rw_pages - copy between pinned remote pages and local iovecs
+ * @pages: array of pinned pages covering the remote range
+ * @offset: offset into the first page at which the remote range starts
+ * @len: number of bytes of the remote range covered by @pages
+ * @iter: local iovec cursor, advanced by the number of bytes copied
+ * @vm_write: 0 to copy remote->local, 1 to copy local->remote
+ * @copied: number of bytes successfully transferred
+ *
+ * Returns 0 if the whole range was copied or the local iovec was
+ * exhausted, -EFAULT if a local buffer could not be accessed.
+ */
+static int process_vm_rw_pages(struct page **pages, unsigned long offset,
+			       size_t len, struct pvm_iter *iter,
+			       int vm_write, ssize_t *copied)
+{
+	*copied = 0;
+
+	while (len && iter->seg < iter->nr_segs) {
+		const struct iovec *iov = &iter->iov[iter->seg];
+		struct page *page = *pages;
+		size_t copy;
+		void *kaddr;
+		int left;
+
+		if (iter->offset == iov->iov_len) {
+			iter->seg++;
+			iter->offset = 0;
+			continue;
+		}
+
+		copy = min_t(size_t, PAGE_SIZE - offset, len);
+		copy = min_t(size_t, copy, iov->iov_len - iter->offset);
+
+		kaddr = kmap(page) + offset;
+		if (vm_write) {
+			left = copy_from_user(kaddr,
+					iov->iov_base + iter->offset, copy);
+			set_page_dirty_lock(page);
+		} else {
+			left = copy_to_user(iov->iov_base + iter->offset,
+					kaddr, copy);
+		}
+		kunmap(page);
+
+		*copied += copy - left;
+		if (left)
+			return -EFAULT;
+
+		iter->offset += copy;
+		len -= copy;
+		offset += copy;
+		if (offset == PAGE_SIZE) {
+			offset = 0;
+			pages++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * process_vm_rw_single_vec - transfer one remote iovec
+ * @addr: start address in the target process
+ * @len: length of the remote segment
+ * @iter: local iovec cursor
+ * @process_pages: scratch array for pinned pages
+ * @max_pages: size of @process_pages
+ * @mm: target mm
+ * @task: target task
+ * @vm_write: 0 to read from the target, 1 to write to it
+ * @copied: number of bytes transferred
+ *
+ * Pins at most @max_pages of the remote range at a time, so large
+ * segments never hold more than a bounded number of page references.
+ */
+static int process_vm_rw_single_vec(unsigned long addr, unsigned long len,
+				    struct pvm_iter *iter,
+				    struct page **process_pages,
+				    unsigned long max_pages,
+				    struct mm_struct *mm,
+				    struct task_struct *task,
+				    int vm_write, ssize_t *copied)
+{
+	unsigned long pa = addr & PAGE_MASK;
+	unsigned long offset = addr - pa;
+	unsigned long nr_pages;
+	int rc = 0;
+
+	*copied = 0;
+	if (len == 0)
+		return 0;
+	nr_pages = (addr + len - 1) / PAGE_SIZE - addr / PAGE_SIZE + 1;
+
+	while (nr_pages && iter->seg < iter->nr_segs) {
+		int pages = min(nr_pages, max_pages);
+		size_t bytes = min_t(size_t, len,
+				     (unsigned long)pages * PAGE_SIZE - offset);
+		ssize_t done;
+		int pinned, i;
+
+		down_read(&mm->mmap_sem);
+		pinned = get_user_pages(task, mm, pa, pages, vm_write, 0,
+					process_pages, NULL);
+		up_read(&mm->mmap_sem);
+		if (pinned <= 0)
+			return -EFAULT;
+		if (pinned < pages) {
+			/* Copy what we got, then report the hole */
+			bytes = (unsigned long)pinned * PAGE_SIZE - offset;
+			rc = -EFAULT;
+		}
+
+		if (process_vm_rw_pages(process_pages, offset, bytes, iter,
+					vm_write, &done))
+			rc = -EFAULT;
+		*copied += done;
+
+		for (i = 0; i < pinned; i++)
+			put_page(process_pages[i]);
+
+		if (rc || done < bytes)
+			break;
+
+		len -= bytes;
+		nr_pages -= pinned;
+		pa += (unsigned long)pinned * PAGE_SIZE;
+		offset = 0;
+	}
+
+	return rc;
+}
+
+/**
+ * process_vm_rw_core - core of reading/writing pages from task specified
+ * @pid: PID of process to read/write from/to
+ * @lvec: iovec array specifying where to copy to/from locally
+ * @liovcnt: size of lvec array
+ * @rvec: iovec array specifying where to copy to/from in the other process
+ * @riovcnt: size of rvec array
+ * @flags: currently unused
+ * @vm_write: 0 if reading from other process, 1 if writing to other process
+ *
+ * Returns the number of bytes read/written or error code.  May return
+ * less bytes than expected if an error occurs during the copying
+ * process.
+ */
+static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
+				  unsigned long liovcnt,
+				  const struct iovec *rvec,
+				  unsigned long riovcnt,
+				  unsigned long flags, int vm_write)
+{
+	struct task_struct *task;
+	struct page *pp_stack[PVM_MAX_PP_ARRAY_COUNT];
+	struct page **process_pages = pp_stack;
+	struct mm_struct *mm;
+	struct pvm_iter iter;
+	unsigned long i;
+	unsigned long nr_pages = 0;
+	unsigned long max_pages;
+	ssize_t bytes_copied = 0;
+	ssize_t copied;
+	ssize_t rc = 0;
+
+	/*
+	 * Work out how many pages the largest remote segment spans, so
+	 * we only allocate as much scratch space as we can actually use.
+	 */
+	for (i = 0; i < riovcnt; i++) {
+		unsigned long start = (unsigned long)rvec[i].iov_base;
+		unsigned long len = rvec[i].iov_len;
+
+		if (len == 0)
+			continue;
+		nr_pages = max(nr_pages, (start + len - 1) / PAGE_SIZE -
+					 start / PAGE_SIZE + 1);
+	}
+	if (nr_pages == 0)
+		return 0;
+
+	max_pages = PVM_MAX_PP_ARRAY_COUNT;
+	if (nr_pages > PVM_MAX_PP_ARRAY_COUNT) {
+		max_pages = min_t(unsigned long, nr_pages,
+				  PVM_MAX_KMALLOC_PAGES);
+		process_pages = kmalloc(max_pages * sizeof(struct page *),
+					GFP_KERNEL);
+		if (!process_pages)
+			return -ENOMEM;
+	}
+
+	/* Get process information */
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	if (!task) {
+		rc = -ESRCH;
+		goto free_proc_pages;
+	}
+
+	/*
+	 * Same rules as PTRACE_ATTACH: the caller must be allowed to
+	 * ptrace the target.  The mm is pinned under task_lock so it
+	 * cannot change identity between the check and its use.
+	 */
+	task_lock(task);
+	if (__ptrace_may_access(task, PTRACE_MODE_ATTACH)) {
+		task_unlock(task);
+		rc = -EPERM;
+		goto put_task_struct;
+	}
+	mm = task->mm;
+	if (!mm || (task->flags & PF_KTHREAD)) {
+		task_unlock(task);
+		rc = -EINVAL;
+		goto put_task_struct;
+	}
+	atomic_inc(&mm->mm_users);
+	task_unlock(task);
+
+	iter.iov = lvec;
+	iter.nr_segs = liovcnt;
+	iter.seg = 0;
+	iter.offset = 0;
+
+	for (i = 0; i < riovcnt && iter.seg < liovcnt; i++) {
+		rc = process_vm_rw_single_vec(
+			(unsigned long)rvec[i].iov_base, rvec[i].iov_len,
+			&iter, process_pages, max_pages, mm, task, vm_write,
+			&copied);
+		bytes_copied += copied;
+		if (rc)
+			break;
+	}
+
+	/* A partial transfer is reported as such, not as an error */
+	if (bytes_copied)
+		rc = bytes_copied;
+
+	mmput(mm);
+
+put_task_struct:
+	put_task_struct(task);
+
+free_proc_pages:
+	if (process_pages != pp_stack)
+		kfree(process_pages);
+	return rc;
+}
+
+/**
+ * process_vm_rw - check iovecs before calling core routine
+ * @pid: PID of process to read/write from/to
+ * @lvec: iovec array specifying where to copy to/from locally
+ * @liovcnt: size of lvec array
+ * @rvec: iovec array specifying where to copy to/from in the other process
+ * @riovcnt: size of rvec array
+ * @flags: currently unused
+ * @vm_write: 0 if reading from other process, 1 if writing to other process
+ *
+ * Returns the number of bytes read/written or error code.  May return
+ * less bytes than expected if an error occurs during the copying
+ * process.
+ */
+static ssize_t process_vm_rw(pid_t pid,
+			     const struct iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	/* Check iovecs */
+	if (vm_write)
+		rc = rw_copy_check_uvector(WRITE, lvec, liovcnt, UIO_FASTIOV,
+					   iovstack_l, &iov_l, 1);
+	else
+		rc = rw_copy_check_uvector(READ, lvec, liovcnt, UIO_FASTIOV,
+					   iovstack_l, &iov_l, 1);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	/* The remote iovec describes another mm: only sanity check it here */
+	rc = rw_copy_check_uvector(READ, rvec, riovcnt, UIO_FASTIOV,
+				   iovstack_r, &iov_r, 0);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+
+	return rc;
+}
+
+SYSCALL_DEFINE6(process_vm_readv, pid_t, pid, const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 0);
+}
+
+SYSCALL_DEFINE6(process_vm_writev, pid_t, pid,
+		const struct iovec __user *, lvec,
+		unsigned long, liovcnt, const struct iovec __user *, rvec,
+		unsigned long, riovcnt,	unsigned long, flags)
+{
+	return process_vm_rw(pid, lvec, liovcnt, rvec, riovcnt, flags, 1);
+}
+
+#ifdef CONFIG_COMPAT
+
+static ssize_t
+compat_process_vm_rw(compat_pid_t pid,
+		     const struct compat_iovec __user *lvec,
+		     unsigned long liovcnt,
+		     const struct compat_iovec __user *rvec,
+		     unsigned long riovcnt,
+		     unsigned long flags, int vm_write)
+{
+	struct iovec iovstack_l[UIO_FASTIOV];
+	struct iovec iovstack_r[UIO_FASTIOV];
+	struct iovec *iov_l = iovstack_l;
+	struct iovec *iov_r = iovstack_r;
+	ssize_t rc;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	if (vm_write)
+		rc = compat_rw_copy_check_uvector(WRITE, lvec, liovcnt,
+						  UIO_FASTIOV, iovstack_l,
+						  &iov_l, 1);
+	else
+		rc = compat_rw_copy_check_uvector(READ, lvec, liovcnt,
+						  UIO_FASTIOV, iovstack_l,
+						  &iov_l, 1);
+	if (rc <= 0)
+		goto free_iovecs;
+	rc = compat_rw_copy_check_uvector(READ, rvec, riovcnt,
+					  UIO_FASTIOV, iovstack_r,
+					  &iov_r, 0);
+	if (rc <= 0)
+		goto free_iovecs;
+
+	rc = process_vm_rw_core(pid, iov_l, liovcnt, iov_r, riovcnt, flags,
+				vm_write);
+
+free_iovecs:
+	if (iov_r != iovstack_r)
+		kfree(iov_r);
+	if (iov_l != iovstack_l)
+		kfree(iov_l);
+
+	return rc;
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_readv(compat_pid_t pid,
+			    const struct compat_iovec __user *lvec,
+			    unsigned long liovcnt,
+			    const struct compat_iovec __user *rvec,
+			    unsigned long riovcnt,
+			    unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 0);
+}
+
+asmlinkage ssize_t
+compat_sys_process_vm_writev(compat_pid_t pid,
+			     const struct compat_iovec __user *lvec,
+			     unsigned long liovcnt,
+			     const struct compat_iovec __user *rvec,
+			     unsigned long riovcnt,
+			     unsigned long flags)
+{
+	return compat_process_vm_rw(pid, lvec, liovcnt, rvec,
+				    riovcnt, flags, 1);
+}
+
+#endif
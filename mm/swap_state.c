@@ -18,6 +18,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/vmstat.h>
 
 #include <asm/pgtable.h>
 
@@ -256,27 +257,89 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+/*
+ * VMA based swap readahead state, kept per vma in swap_readahead_info:
+ * the page aligned address of the last swap fault, the readahead window
+ * chosen for it, and the number of readahead hits seen since.
+ */
+#define SWAP_RA_ORDER_CEILING	5
+
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* Initial readahead hits is 4 to start up with a small window */
+#define GET_SWAP_RA_VAL(vma)					\
+	(atomic_long_read(&(vma)->swap_readahead_info) ? : 4)
+
+/*
+ * Use VMA based readahead if set and no swap device seeks expensively:
+ * on rotating media the swap slot order is what keeps the disk head
+ * busy, so the physical readaround is kept there.
+ */
+int swap_vma_readahead __read_mostly = 1;
+atomic_t nr_rotate_swap = ATOMIC_INIT(0);
+
+static inline bool swap_use_vma_readahead(void)
+{
+	return swap_vma_readahead && !atomic_read(&nr_rotate_swap);
+}
+
+/*
+ * Lookup a swap entry in the swap cache. A found page will be returned
+ * unlocked and with its refcount incremented - we rely on the kernel
+ * lock getting page table operations atomic even if we drop the page
+ * lock before returning.
+ *
+ * @vma and @addr identify the faulting mapping, if any, so that a hit
+ * on a page brought in by VMA readahead can widen its next window.
+ */
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma) {
+				unsigned long ra_val = GET_SWAP_RA_VAL(vma);
+				unsigned long win = SWAP_RA_WIN(ra_val);
+				unsigned long hits = SWAP_RA_HITS(ra_val);
+
+				hits = min(hits + 1, SWAP_RA_HITS_MAX);
+				atomic_long_set(&vma->swap_readahead_info,
+						SWAP_RA_VAL(addr, win, hits));
+			}
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
+/*
  * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
+ * and reading the disk if it is not already cached.  A page newly read
+ * on behalf of readahead is marked PageReadahead so a later fault on it
+ * can be counted as a hit.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			int readahead)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
@@ -329,6 +392,10 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			/*
 			 * Initiate read into locked page and return.
 			 */
+			if (readahead) {
+				SetPageReadahead(new_page);
+				count_vm_event(SWAP_RA);
+			}
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
 			return new_page;
@@ -348,6 +415,169 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr, 0);
+}
+
+static unsigned int swapin_nr_pages(unsigned long fpfn, unsigned long pfn,
+				    unsigned long hits, unsigned int max_pages,
+				    unsigned int prev_win)
+{
+	unsigned int pages, last_ra;
+
+	/*
+	 * This heuristic has been found to work well on both sequential and
+	 * random loads, swapping to hard disk or to SSD: please don't ask
+	 * what the "+ 2" means, it just happens to work well, that's all.
+	 */
+	pages = hits + 2;
+	if (pages == 2) {
+		/*
+		 * We can have no readahead hits to judge by: but must not get
+		 * stuck here forever, so check for an adjacent address instead.
+		 */
+		if (fpfn != pfn + 1 && fpfn != pfn - 1)
+			pages = 1;
+	} else {
+		unsigned int roundup = 4;
+		while (roundup < pages)
+			roundup <<= 1;
+		pages = roundup;
+	}
+
+	if (pages > max_pages)
+		pages = max_pages;
+
+	/* Don't shrink readahead too fast */
+	last_ra = prev_win / 2;
+	if (pages < last_ra)
+		pages = last_ra;
+
+	return pages;
+}
+
+/*
+ * Find the pte covering @addr.  The caller holds mmap_sem, which keeps
+ * the page table pages from being freed under us.
+ */
+static pmd_t *swap_ra_pmd(struct mm_struct *mm, unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, addr);
+	if (pgd_none_or_clear_bad(pgd))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none_or_clear_bad(pud))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none_or_clear_bad(pmd))
+		return NULL;
+	return pmd;
+}
+
+/**
+ * swapin_vma_readahead - swap in pages adjacent in the faulting vma
+ * @fentry: swap entry of the faulting page
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma this address belongs to
+ * @faddr: faulting address
+ *
+ * Returns the struct page for entry and addr, after queueing swapin.
+ *
+ * Slot order in the swap area stops matching address order once swap
+ * has been in use for a while, so instead of reading around the slot we
+ * read the swap entries behind the virtual pages around @faddr.  The
+ * window follows the direction of the faults and grows with the hits on
+ * previously read ahead pages of the vma.
+ */
+static struct page *swapin_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long faddr)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	unsigned long ra_val, pfn, fpfn, start, end, left;
+	unsigned long lpfn, rpfn;
+	unsigned int max_win, win, prev_win, hits, i;
+	struct page *page;
+	spinlock_t *ptl;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	max_win = 1 << min_t(unsigned int, page_cluster,
+			     SWAP_RA_ORDER_CEILING);
+	fpfn = faddr >> PAGE_SHIFT;
+	ra_val = GET_SWAP_RA_VAL(vma);
+	pfn = SWAP_RA_ADDR(ra_val) >> PAGE_SHIFT;
+	prev_win = SWAP_RA_WIN(ra_val);
+	hits = SWAP_RA_HITS(ra_val);
+
+	win = 1;
+	if (max_win > 1)
+		win = swapin_nr_pages(fpfn, pfn, hits, max_win, prev_win);
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(faddr, win, 0));
+	if (win == 1)
+		goto skip;
+
+	/* Read in the direction of the faults, or around an isolated one */
+	if (fpfn == pfn + 1) {
+		lpfn = fpfn;
+		rpfn = fpfn + win;
+	} else if (pfn == fpfn + 1) {
+		lpfn = fpfn - win + 1;
+		rpfn = fpfn + 1;
+	} else {
+		left = (win - 1) / 2;
+		lpfn = fpfn - left;
+		rpfn = fpfn + win - left;
+	}
+
+	/* Stay within the vma and the page table page holding faddr */
+	start = max(lpfn << PAGE_SHIFT, vma->vm_start);
+	start = max(start, faddr & PMD_MASK);
+	end = min(rpfn << PAGE_SHIFT, vma->vm_end);
+	end = min(end, (faddr & PMD_MASK) + PMD_SIZE);
+
+	pmd = swap_ra_pmd(vma->vm_mm, faddr);
+	if (!pmd)
+		goto skip;
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, start, &ptl);
+	for (i = 0; start + ((unsigned long)i << PAGE_SHIFT) < end; i++)
+		ptes[i] = pte[i];
+	pte_unmap_unlock(pte, ptl);
+
+	for (i = 0; start < end; i++, start += PAGE_SIZE) {
+		swp_entry_t entry;
+
+		if (start == (faddr & PAGE_MASK))
+			continue;
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		page = __read_swap_cache_async(entry, gfp_mask, vma, start, 1);
+		if (!page)
+			continue;
+		page_cache_release(page);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, faddr);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -365,6 +595,9 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
  * This has been extended to use the NUMA policies from the mm triggering
  * the readahead.
  *
+ * When no rotating swap device is in use, faults with a vma read ahead
+ * by virtual address instead, see swapin_vma_readahead().
+ *
  * Caller must hold down_read on the vma->vm_mm if vma is not NULL.
  */
 struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
@@ -375,6 +608,9 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	unsigned long offset;
 	unsigned long end_offset;
 
+	if (vma && swap_use_vma_readahead())
+		return swapin_vma_readahead(entry, gfp_mask, vma, addr);
+
 	/*
 	 * Get starting offset for readaround, and number of pages to read.
 	 * Adjust starting address by readbehind (for NUMA interleave case)?
@@ -385,8 +621,9 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = __read_swap_cache_async(swp_entry(swp_type(entry),
+						offset), gfp_mask, vma, addr,
+						offset != swp_offset(entry));
 		if (!page)
 			break;
 		page_cache_release(page);
@@ -38,6 +38,7 @@
 #include <linux/kthread.h>
 #include <linux/freezer.h>
 #include <linux/memcontrol.h>
+#include <linux/vmpressure.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
 
@@ -164,6 +165,11 @@ static unsigned long zone_nr_lru_pages(struct zone *zone,
 void register_shrinker(struct shrinker *shrinker)
 {
 	shrinker->nr = 0;
+	shrinker->nr_node = NULL;
+	/* Without the per-node counts we just fall back to ->shrink */
+	if (shrinker->shrink_node)
+		shrinker->nr_node = kcalloc(nr_node_ids, sizeof(long),
+					    GFP_KERNEL);
 	down_write(&shrinker_rwsem);
 	list_add_tail(&shrinker->list, &shrinker_list);
 	up_write(&shrinker_rwsem);
@@ -178,10 +184,76 @@ void unregister_shrinker(struct shrinker *shrinker)
 	down_write(&shrinker_rwsem);
 	list_del(&shrinker->list);
 	up_write(&shrinker_rwsem);
+	kfree(shrinker->nr_node);
 }
 EXPORT_SYMBOL(unregister_shrinker);
 
 #define SHRINK_BATCH 128
+
+static inline int do_shrink(struct shrinker *shrinker, int nr_to_scan,
+			    gfp_t gfp_mask, int nid)
+{
+	if (nid < 0)
+		return (*shrinker->shrink)(nr_to_scan, gfp_mask);
+	return (*shrinker->shrink_node)(nr_to_scan, gfp_mask, nid);
+}
+
+/*
+ * Age one shrinker, or one node of it if @nid is not negative, in proportion
+ * to the page reclaim work done.  @nr is the matching count of deferred work.
+ */
+static unsigned long shrink_slab_one(struct shrinker *shrinker, long *nr,
+			int nid, unsigned long scanned, gfp_t gfp_mask,
+			unsigned long lru_pages)
+{
+	unsigned long long delta;
+	unsigned long total_scan;
+	unsigned long max_pass = do_shrink(shrinker, 0, gfp_mask, nid);
+	unsigned long ret = 0;
+
+	delta = (4 * scanned) / shrinker->seeks;
+	delta *= max_pass;
+	do_div(delta, lru_pages + 1);
+	*nr += delta;
+	if (*nr < 0) {
+		printk(KERN_ERR "shrink_slab: %pF negative objects to "
+		       "delete nr=%ld\n",
+		       shrinker->shrink, *nr);
+		*nr = max_pass;
+	}
+
+	/*
+	 * Avoid risking looping forever due to too large nr value:
+	 * never try to free more than twice the estimate number of
+	 * freeable entries.
+	 */
+	if (*nr > max_pass * 2)
+		*nr = max_pass * 2;
+
+	total_scan = *nr;
+	*nr = 0;
+
+	while (total_scan >= SHRINK_BATCH) {
+		long this_scan = SHRINK_BATCH;
+		int shrink_ret;
+		int nr_before;
+
+		nr_before = do_shrink(shrinker, 0, gfp_mask, nid);
+		shrink_ret = do_shrink(shrinker, this_scan, gfp_mask, nid);
+		if (shrink_ret == -1)
+			break;
+		if (shrink_ret < nr_before)
+			ret += nr_before - shrink_ret;
+		count_vm_events(SLABS_SCANNED, this_scan);
+		total_scan -= this_scan;
+
+		cond_resched();
+	}
+
+	*nr += total_scan;
+	return ret;
+}
+
 /*
  * Call the shrink functions to age shrinkable caches
  *
@@ -199,65 +271,38 @@ EXPORT_SYMBOL(unregister_shrinker);
  * are eligible for the caller's allocation attempt.  It is used for balancing
  * slab reclaim versus page reclaim.
  *
+ * `nodes' are the nodes those zones belong to, or NULL for all of them.
+ * Shrinkers with per-node LRUs are only asked to scan objects on these
+ * nodes; the others are aged as a whole.
+ *
  * Returns the number of slab objects which we shrunk.
  */
 unsigned long shrink_slab(unsigned long scanned, gfp_t gfp_mask,
-			unsigned long lru_pages)
+			unsigned long lru_pages, const nodemask_t *nodes)
 {
 	struct shrinker *shrinker;
 	unsigned long ret = 0;
+	int nid;
 
 	if (scanned == 0)
 		scanned = SWAP_CLUSTER_MAX;
 
+	if (!nodes)
+		nodes = &node_states[N_HIGH_MEMORY];
+
 	if (!down_read_trylock(&shrinker_rwsem))
 		return 1;	/* Assume we'll be able to shrink next time */
 
 	list_for_each_entry(shrinker, &shrinker_list, list) {
-		unsigned long long delta;
-		unsigned long total_scan;
-		unsigned long max_pass = (*shrinker->shrink)(0, gfp_mask);
-
-		delta = (4 * scanned) / shrinker->seeks;
-		delta *= max_pass;
-		do_div(delta, lru_pages + 1);
-		shrinker->nr += delta;
-		if (shrinker->nr < 0) {
-			printk(KERN_ERR "shrink_slab: %pF negative objects to "
-			       "delete nr=%ld\n",
-			       shrinker->shrink, shrinker->nr);
-			shrinker->nr = max_pass;
-		}
-
-		/*
-		 * Avoid risking looping forever due to too large nr value:
-		 * never try to free more than twice the estimate number of
-		 * freeable entries.
-		 */
-		if (shrinker->nr > max_pass * 2)
-			shrinker->nr = max_pass * 2;
-
-		total_scan = shrinker->nr;
-		shrinker->nr = 0;
-
-		while (total_scan >= SHRINK_BATCH) {
-			long this_scan = SHRINK_BATCH;
-			int shrink_ret;
-			int nr_before;
-
-			nr_before = (*shrinker->shrink)(0, gfp_mask);
-			shrink_ret = (*shrinker->shrink)(this_scan, gfp_mask);
-			if (shrink_ret == -1)
-				break;
-			if (shrink_ret < nr_before)
-				ret += nr_before - shrink_ret;
-			count_vm_events(SLABS_SCANNED, this_scan);
-			total_scan -= this_scan;
-
-			cond_resched();
+		if (!shrinker->nr_node) {
+			ret += shrink_slab_one(shrinker, &shrinker->nr, -1,
+					scanned, gfp_mask, lru_pages);
+			continue;
 		}
-
-		shrinker->nr += total_scan;
+		for_each_node_mask(nid, *nodes)
+			ret += shrink_slab_one(shrinker,
+					&shrinker->nr_node[nid], nid,
+					scanned, gfp_mask, lru_pages);
 	}
 	up_read(&shrinker_rwsem);
 	return ret;
@@ -1637,6 +1682,8 @@ static void shrink_zone(int priority, struct zone *zone,
 	unsigned long percent[2];	/* anon @ 0; file @ 1 */
 	enum lru_list l;
 	unsigned long nr_reclaimed = sc->nr_reclaimed;
+	unsigned long prev_reclaimed = sc->nr_reclaimed;
+	unsigned long prev_scanned = sc->nr_scanned;
 	unsigned long swap_cluster_max = sc->swap_cluster_max;
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(zone, sc);
 	int noswap = 0;
@@ -1696,6 +1743,11 @@ static void shrink_zone(int priority, struct zone *zone,
 	if (inactive_anon_is_low(zone, sc) && nr_swap_pages > 0)
 		shrink_active_list(SWAP_CLUSTER_MAX, zone, sc, priority, 0);
 
+	/* Record the reclaim efficiency of this pass for listeners */
+	vmpressure(sc->gfp_mask, sc->mem_cgroup,
+		   sc->nr_scanned - prev_scanned,
+		   sc->nr_reclaimed - prev_reclaimed);
+
 	throttle_vm_writeout(sc->gfp_mask);
 }
 
@@ -1778,6 +1830,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 	unsigned long total_scanned = 0;
 	struct reclaim_state *reclaim_state = current->reclaim_state;
 	unsigned long lru_pages = 0;
+	nodemask_t lru_nodes = NODE_MASK_NONE;
 	struct zoneref *z;
 	struct zone *zone;
 	enum zone_type high_zoneidx = gfp_zone(sc->gfp_mask);
@@ -1796,10 +1849,12 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 				continue;
 
 			lru_pages += zone_reclaimable_pages(zone);
+			node_set(zone_to_nid(zone), lru_nodes);
 		}
 	}
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
+		vmpressure_prio(sc->gfp_mask, sc->mem_cgroup, priority);
 		sc->nr_scanned = 0;
 		if (!priority)
 			disable_swap_token();
@@ -1809,7 +1864,8 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		 * over limit cgroups
 		 */
 		if (scanning_global_lru(sc)) {
-			shrink_slab(sc->nr_scanned, sc->gfp_mask, lru_pages);
+			shrink_slab(sc->nr_scanned, sc->gfp_mask, lru_pages,
+				    &lru_nodes);
 			if (reclaim_state) {
 				sc->nr_reclaimed += reclaim_state->reclaimed_slab;
 				reclaim_state->reclaimed_slab = 0;
@@ -1975,6 +2031,7 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order)
 	int i;
 	unsigned long total_scanned;
 	struct reclaim_state *reclaim_state = current->reclaim_state;
+	nodemask_t lru_nodes = nodemask_of_node(pgdat->node_id);
 	struct scan_control sc = {
 		.gfp_mask = GFP_KERNEL,
 		.may_unmap = 1,
@@ -2093,7 +2150,7 @@ loop_again:
 				shrink_zone(priority, zone, &sc);
 			reclaim_state->reclaimed_slab = 0;
 			nr_slab = shrink_slab(sc.nr_scanned, GFP_KERNEL,
-						lru_pages);
+						lru_pages, &lru_nodes);
 			sc.nr_reclaimed += reclaim_state->reclaimed_slab;
 			total_scanned += sc.nr_scanned;
 			if (zone_is_all_unreclaimable(zone))
@@ -2381,7 +2438,7 @@ unsigned long shrink_all_memory(unsigned long nr_pages)
 	/* If slab caches are huge, it's better to hit them first */
 	while (nr_slab >= lru_pages) {
 		reclaim_state.reclaimed_slab = 0;
-		shrink_slab(nr_pages, sc.gfp_mask, lru_pages);
+		shrink_slab(nr_pages, sc.gfp_mask, lru_pages, NULL);
 		if (!reclaim_state.reclaimed_slab)
 			break;
 
@@ -2418,7 +2475,7 @@ unsigned long shrink_all_memory(unsigned long nr_pages)
 
 			reclaim_state.reclaimed_slab = 0;
 			shrink_slab(sc.nr_scanned, sc.gfp_mask,
-				    global_reclaimable_pages());
+				    global_reclaimable_pages(), NULL);
 			sc.nr_reclaimed += reclaim_state.reclaimed_slab;
 			if (sc.nr_reclaimed >= nr_pages)
 				goto out;
@@ -2436,7 +2493,7 @@ unsigned long shrink_all_memory(unsigned long nr_pages)
 		do {
 			reclaim_state.reclaimed_slab = 0;
 			shrink_slab(nr_pages, sc.gfp_mask,
-				    global_reclaimable_pages());
+				    global_reclaimable_pages(), NULL);
 			sc.nr_reclaimed += reclaim_state.reclaimed_slab;
 		} while (sc.nr_reclaimed < nr_pages &&
 				reclaim_state.reclaimed_slab > 0);
@@ -2640,10 +2697,12 @@ static int __zone_reclaim(struct zone *zone, gfp_t gfp_mask, unsigned int order)
 		 * by the same nr_pages that we used for reclaiming unmapped
 		 * pages.
 		 *
-		 * Note that shrink_slab will free memory on all zones and may
-		 * take a long time.
+		 * Caches with per-node LRUs are only shrunk on this node, the
+		 * others free memory on all zones, which may take a long time.
 		 */
-		while (shrink_slab(sc.nr_scanned, gfp_mask, order) &&
+		nodemask_t nodes = nodemask_of_node(zone_to_nid(zone));
+
+		while (shrink_slab(sc.nr_scanned, gfp_mask, order, &nodes) &&
 			zone_page_state(zone, NR_SLAB_RECLAIMABLE) >
 				slab_reclaimable - nr_pages)
 			;
@@ -520,6 +520,21 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * Permission check for the RCU path walk: the caller holds no reference
+ * on @inode and may not sleep.  Only the default hook is known to be
+ * safe there, so anything else sends the walk back to ref-counted mode.
+ */
+int security_inode_permission_rcu(struct inode *inode, int mask)
+{
+	if (unlikely(IS_PRIVATE(inode)))
+		return 0;
+	if (security_ops->inode_permission !=
+	    default_security_ops.inode_permission)
+		return -ECHILD;
+	return security_ops->inode_permission(inode, mask);
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))